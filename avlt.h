@@ -8,144 +8,693 @@
 
 #include <iostream>
 #include <vector>
-#include <stack>
+#include <string>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <atomic>
 
 using namespace std;
 
-template<typename KeyT, typename ValueT>
+// hint that *p will be read soon; used to overlap the cache misses of
+// several descents at once
+#ifndef AVLT_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define AVLT_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define AVLT_PREFETCH(p) ((void)0)
+#endif
+#endif
+
+// define AVLT_ORDER_STATISTICS (the same way in every file that includes
+// this header) to keep subtree sizes in the nodes, which adds rank(),
+// select() and range_count(). It costs an int per node and a counter
+// update per ancestor on every insert and erase.
+
+// define AVLT_STATS (again the same way everywhere) to have each tree
+// count what its operations cost, see stats(). Without it, none of the
+// counting is compiled in.
+
+#include "frozen_avlt.h"
+
+template<typename KeyT, typename ValueT, typename Compare, typename Alloc>
+class concurrent_avlt;
+
+template<typename KeyT, typename ValueT, typename Compare>
+class mapped_avlt;
+
+//
+// avlt_stats is what avlt::stats() returns with AVLT_STATS defined: the
+// totals since the tree was created or last reset_stats(). A histogram
+// entry [d] counts the operations that took d steps; the last entry also
+// takes everything longer.
+//
+struct avlt_stats
+{
+  static const int Buckets = 65;
+
+  unsigned long long Rotations;          // single rotations; a double rotation is 2
+  unsigned long long Inserts;            // keys inserted (not ones already there)
+  unsigned long long Searches;           // lookup descents: search, [], find, bounds, ranges
+  unsigned long long SearchComparisons;  // comparator calls those lookups made
+  unsigned long long NodeAllocations;    // nodes built
+  unsigned long long NodeFrees;          // nodes destroyed
+  unsigned long long RebalanceDepths[Buckets];  // # of ancestors an insert rechecked on the way back up
+  unsigned long long PathLengths[Buckets];      // # of nodes a lookup, insert or erase descent visited
+};
+
+//
+// Compare orders the keys, the same way as for std::map: Compare()(a, b)
+// is true when a goes before b, and two keys are the same key when
+// neither goes before the other. If Compare has an is_transparent member
+// type, like std::less<>, search, [], find, lower_bound and upper_bound
+// also take any key type it can compare with KeyT, e.g. std::string_view
+// for a std::string tree, without building a KeyT first.
+//
+// Alloc is used for the tree's nodes. It is rebound internally, so any
+// standard allocator works, including std::pmr::polymorphic_allocator to
+// place the nodes in a memory_resource.
+//
+// SharedLinks is for concurrent_avlt, whose readers follow the links
+// while a writer changes them: it makes every link and flag an atomic.
+// Other trees leave it off and keep plain pointers.
+//
+template<typename KeyT, typename ValueT, typename Compare = std::less<KeyT>,
+         typename Alloc = std::allocator<std::pair<const KeyT, ValueT>>,
+         bool SharedLinks = false>
 class avlt
 {
 private:
+  friend class concurrent_avlt<KeyT, ValueT, Compare, Alloc>;
+  template<typename K, typename V, typename C> friend class mapped_avlt;
+
+	/* SharedField
+	 *
+	 * a link or flag that concurrent_avlt's lock-free readers load while
+	 * a writer may be storing to it. It reads and assigns like a plain T,
+	 * but as an atomic, so those overlapping accesses aren't a data race:
+	 * loads are relaxed, and stores are release, so a reader that loads
+	 * a link with acquire sees the node it points to fully built. Both
+	 * compile to plain moves on x86.
+	 */
+
+	template<typename T>
+	class SharedField
+	{
+	public:
+		SharedField(T value = T()) : Field(value) { }
+		SharedField(const SharedField& other) : Field(other.load()) { }
+
+		SharedField& operator=(const SharedField& other) { store(other.load()); return *this; }
+		SharedField& operator=(T value) { store(value); return *this; }
+
+		operator T() const { return load(); }
+		T operator->() const { return load(); }
+
+		T load(std::memory_order order = std::memory_order_relaxed) const { return Field.load(order); }
+		void store(T value) { Field.store(value, std::memory_order_release); }
+
+	private:
+		std::atomic<T> Field;
+	};
+
+	// a link or flag: a SharedField for concurrent_avlt, else a plain T
+	template<typename T>
+	using LinkField = typename std::conditional<SharedLinks, SharedField<T>, T>::type;
+
   struct NODE
   {
     KeyT   Key;
     ValueT Value;
-    NODE*  Left;
-    NODE*  Right;
-    bool   isThreaded; // true => Right is a thread, false => non-threaded
+    LinkField<NODE*> Left;
+    LinkField<NODE*> Right;
+    LinkField<bool>  isThreaded; // true => Right is a thread, false => non-threaded
     int    Height;     // height of tree rooted at this node
+#ifdef AVLT_ORDER_STATISTICS
+    int    Count = 1;  // # of nodes in tree rooted at this node
+#endif
+
+    // an unlinked leaf, its value built in place from args
+    template<typename K, typename... Args>
+    NODE(K&& key, std::piecewise_construct_t, Args&&... args)
+      : Key(std::forward<K>(key)), Value(std::forward<Args>(args)...),
+        Left(nullptr), Right(nullptr), isThreaded(false), Height(0)
+    { }
   };
 
+	/* NodePool
+	 * 
+	 * Slab allocator for the tree's nodes. Nodes are carved out of
+	 * slabs obtained from Alloc, and nodes given back go onto a free
+	 * list so the next insert reuses them. release() hands every slab
+	 * back to Alloc at once, so clearing a tree never frees nodes one
+	 * at a time.
+	 */
+	class NodePool
+	{
+	private:
+		union Slot;
+		
+		// kept in one extra slot past the end of every slab, so the list
+		// of slabs needs no heap storage of its own
+		struct SlabTail
+		{
+			Slot*  NextSlab; // tail slot of the slab made before, or nullptr
+			size_t Count;    // # of node slots in front of this one
+		};
+		
+		union Slot
+		{
+			Slot* NextFree;
+			SlabTail Tail;
+			alignas(NODE) unsigned char Storage[sizeof(NODE)];
+		};
+		
+		using SlotAlloc  = typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>;
+		using SlotTraits = std::allocator_traits<SlotAlloc>;
+		
+		static const size_t FirstSlab = 64;      // slots in the first slab
+		static const size_t MaxSlab   = 1 << 16; // slabs double up to this many slots
+		
+		SlotAlloc Allocator;
+		Slot*  Slabs;    // tail slot of the newest slab, which leads to the rest
+		size_t LastGrow; // # of slots in the slab grow() made last, 0 if none
+		Slot*  FreeList; // nodes given back, reused before the slabs
+		Slot*  Bump;     // next untouched slot in the newest slab
+		Slot*  BumpEnd;  // one past the newest slab
+		size_t Live;     // # of nodes handed out and not given back
+		
+		// count slots and a tail, linked in front of the other slabs
+		Slot* newSlab(size_t count)
+		{
+			Slot* slab = SlotTraits::allocate(Allocator, count + 1);
+			slab[count].Tail.NextSlab = Slabs;
+			slab[count].Tail.Count = count;
+			Slabs = &slab[count];
+			return slab;
+		}
+		
+		void grow()
+		{
+			size_t count = (LastGrow == 0) ? FirstSlab : LastGrow * 2;
+			if(count > MaxSlab)
+				count = MaxSlab;
+			
+			Slot* slab = newSlab(count);
+			LastGrow = count;
+			Bump = slab;
+			BumpEnd = slab + count;
+		}
+		
+	public:
+		static const size_t SlotSize = sizeof(Slot); // bytes between nodes in a block
+		
+		explicit NodePool(const Alloc& alloc)
+			: Allocator(alloc), Slabs(nullptr), LastGrow(0), FreeList(nullptr), Bump(nullptr),
+			  BumpEnd(nullptr), Live(0)
+		{ }
+		
+		NodePool(const NodePool&) = delete;
+		NodePool& operator=(const NodePool&) = delete;
+		
+		// takes over every slab of other, leaving it empty
+		NodePool(NodePool&& other) noexcept
+			: Allocator(std::move(other.Allocator)), Slabs(other.Slabs), LastGrow(other.LastGrow),
+			  FreeList(other.FreeList), Bump(other.Bump), BumpEnd(other.BumpEnd), Live(other.Live)
+		{
+			other.Slabs = nullptr;
+			other.LastGrow = 0;
+			other.FreeList = nullptr;
+			other.Bump = nullptr;
+			other.BumpEnd = nullptr;
+			other.Live = 0;
+		}
+		
+		// takes over every slab of other, after giving back its own; other's
+		// allocator comes along when Alloc says it propagates on move,
+		// otherwise the two must already be equal
+		NodePool& operator=(NodePool&& other) noexcept
+		{
+			if(this == &other)
+				return *this;
+			
+			release();
+			moveAllocator(Allocator, other.Allocator,
+			              typename SlotTraits::propagate_on_container_move_assignment());
+			Slabs = other.Slabs;
+			LastGrow = other.LastGrow;
+			FreeList = other.FreeList;
+			Bump = other.Bump;
+			BumpEnd = other.BumpEnd;
+			Live = other.Live;
+			
+			other.Slabs = nullptr;
+			other.LastGrow = 0;
+			other.FreeList = nullptr;
+			other.Bump = nullptr;
+			other.BumpEnd = nullptr;
+			other.Live = 0;
+			return *this;
+		}
+		
+		static void moveAllocator(SlotAlloc& to, SlotAlloc& from, std::true_type)
+		{
+			to = std::move(from);
+		}
+		
+		static void moveAllocator(SlotAlloc&, SlotAlloc&, std::false_type)
+		{ }
+		
+		// allocators only trade places when Alloc says they propagate
+		static void swapAllocators(SlotAlloc& a, SlotAlloc& b, std::true_type)
+		{
+			using std::swap;
+			swap(a, b);
+		}
+		
+		static void swapAllocators(SlotAlloc&, SlotAlloc&, std::false_type)
+		{ }
+		
+		void swap(NodePool& other) noexcept
+		{
+			using std::swap;
+			swapAllocators(Allocator, other.Allocator,
+			               typename SlotTraits::propagate_on_container_swap());
+			swap(Slabs, other.Slabs);
+			swap(LastGrow, other.LastGrow);
+			swap(FreeList, other.FreeList);
+			swap(Bump, other.Bump);
+			swap(BumpEnd, other.BumpEnd);
+			swap(Live, other.Live);
+		}
+		
+		~NodePool()
+		{
+			release();
+		}
+		
+		// raw storage for one NODE; the caller constructs it
+		void* allocate()
+		{
+			Slot* slot;
+			
+			if(FreeList != nullptr)
+			{
+				slot = FreeList;
+				FreeList = FreeList->NextFree;
+			}
+			else
+			{
+				if(Bump == BumpEnd)
+					grow();
+				slot = Bump++;
+			}
+			
+			Live++;
+			return slot->Storage;
+		}
+		
+		// raw storage for count NODEs laid out one after the other,
+		// SlotSize bytes apart, which the caller constructs
+		unsigned char* allocate_block(size_t count)
+		{
+			if(count == 0)
+				return nullptr;
+			
+			Slot* slab = newSlab(count);  // grow() still doubles from its own last slab
+			Live += count;
+			return slab[0].Storage;
+		}
+		
+		// takes back the storage of a NODE that was already destroyed
+		void deallocate(NODE* node)
+		{
+			Slot* slot = reinterpret_cast<Slot*>(node);
+			slot->NextFree = FreeList;
+			FreeList = slot;
+			Live--;
+		}
+		
+		// returns every slab to Alloc; all nodes must already be destroyed
+		void release()
+		{
+			while(Slabs != nullptr)
+			{
+				Slot* next = Slabs->Tail.NextSlab;
+				size_t count = Slabs->Tail.Count;
+				SlotTraits::deallocate(Allocator, Slabs - count, count + 1);
+				Slabs = next;
+			}
+			
+			LastGrow = 0;
+			FreeList = nullptr;
+			Bump = nullptr;
+			BumpEnd = nullptr;
+			Live = 0;
+		}
+		
+		// puts every slot of every slab on the free list, keeping the slabs;
+		// all nodes must already be destroyed
+		void recycle()
+		{
+			FreeList = nullptr;
+			for(Slot* tail = Slabs; tail != nullptr; tail = tail->Tail.NextSlab)
+			{
+				for(Slot* slot = tail - tail->Tail.Count; slot != tail; slot++)
+				{
+					slot->NextFree = FreeList;
+					FreeList = slot;
+				}
+			}
+			
+			Bump = nullptr;
+			BumpEnd = nullptr;
+			Live = 0;
+		}
+		
+		// bytes currently held in slabs
+		size_t capacity_bytes() const
+		{
+			size_t total = 0;
+			for(Slot* tail = Slabs; tail != nullptr; tail = tail->Tail.NextSlab)
+				total += (tail->Tail.Count + 1) * sizeof(Slot);
+			return total;
+		}
+		
+		Alloc get_allocator() const
+		{
+			return Alloc(Allocator);
+		}
+	};
+
+  NodePool Pool; // where every NODE of this tree lives
+  Compare  Less; // orders the keys
+#ifdef AVLT_STATS
+	/* StatsCounters
+	 * 
+	 * the counters behind stats(). They are atomic since lookups count
+	 * too, and lookups may run on several threads at once; they belong
+	 * to this object, so copies and moves start their own from zero.
+	 */
+	struct StatsCounters
+	{
+		std::atomic<unsigned long long> Rotations, Inserts, Searches, SearchComparisons;
+		std::atomic<unsigned long long> NodeAllocations, NodeFrees;
+		std::atomic<unsigned long long> RebalanceDepths[avlt_stats::Buckets];
+		std::atomic<unsigned long long> PathLengths[avlt_stats::Buckets];
+		
+		StatsCounters() { reset(); }
+		
+		void reset()
+		{
+			Rotations = 0;
+			Inserts = 0;
+			Searches = 0;
+			SearchComparisons = 0;
+			NodeAllocations = 0;
+			NodeFrees = 0;
+			for(int i = 0; i < avlt_stats::Buckets; i++)
+			{
+				RebalanceDepths[i] = 0;
+				PathLengths[i] = 0;
+			}
+		}
+	};
+	
+	mutable StatsCounters Stats;
+#endif
   NODE* Root;  // pointer to root node of tree (nullptr if empty)
 	NODE* RangeRoot;
   int   Size;  // # of nodes in the tree (0 if empty)
 	
-	NODE* ogRoot; // Allows "Root" to be moved while this one holds its original place
+	LinkField<NODE*> ogRoot; // same as Root; Root used to double as the begin()/next() position
+	NODE* Cursor; // next node begin()/next() will return (nullptr once done)
 	bool hasBegun; // Checks whether or not the tree has called begin()
 
 	
 	
-	// insertCopy()
-	// 
-	// Called when making a copy of a tree/node. It is called recursively
-	// so that the whole tree ends up being copied to the new one.
-	// If the node it's trying to insert is a nullptr, it doesnt insert and
-	// returns
-	// 
-	void insertCopy(NODE* orig)
+	/* cloneTree()
+	 * 
+	 * Called when making a copy of a tree. Copies the subtree rooted at
+	 * orig in one preorder pass, keeping its shape and heights, so no
+	 * searching or rotating is needed. "after" is the copy of the node
+	 * that follows this whole subtree in order (nullptr if none); that is
+	 * where the subtree's rightmost node has to be threaded to.
+	 */
+	
+	NODE* cloneTree(const NODE* orig, NODE* after)
 	{
 		if(orig == nullptr)
-			return;
-			
-		copy_insert(orig->Key, orig->Value, orig->Height);
-
-		insertCopy(orig->Left);
-		if(!orig->isThreaded)
-			insertCopy(orig->Right);
+			return nullptr;
 		
+		NODE* node = createNode(orig->Key, orig->Value);
+		node->Height = orig->Height;
+		copyCount(node, orig);
+		node->Left = cloneTree(orig->Left, node);
+		linkCloneRight(orig, node, after);
+		node->Right = (orig->isThreaded || orig->Right == nullptr) ? after : cloneTree(orig->Right, after);
+		return node;
 	}
 	
-	/* copy_insert()
+	/* linkCloneRight()
 	 * 
-	 * function to help the copy constructor and assignment operator
-	 * by copying the contents of 1 tree in preorder fashion to another
-	 * by inserting without rotations because it is already balanced
+	 * sets the thread flag of a copied node from its original: a node
+	 * without a right child is threaded unless it is the very last one
 	 */
 	
-	void copy_insert(KeyT key, ValueT value, int height)
+	static void linkCloneRight(const NODE* orig, NODE* node, NODE* after)
 	{
-		NODE* prev = nullptr;
-		NODE* cur = ogRoot;
+		if(orig->isThreaded || orig->Right == nullptr)
+			node->isThreaded = (after != nullptr);
+		else
+			node->isThreaded = false;
+	}
+	
+	/* CloneTask
+	 * 
+	 * one subtree handed to a worker by cloneParallel(). Link is where
+	 * the copy's root has to be stored, and Slots/Count is the storage
+	 * the worker builds the copy in.
+	 */
+	
+	struct CloneTask
+	{
+		const NODE* Orig;
+		NODE*  After;
+		LinkField<NODE*>* Link;
+		size_t Count;
+		unsigned char* Slots;
+	};
+	
+	/* cloneTop()
+	 * 
+	 * copies the top "depth" levels of a tree like cloneTree() does, and
+	 * records every subtree below them as a CloneTask instead of copying it
+	 */
+	
+	NODE* cloneTop(const NODE* orig, NODE* after, int depth, LinkField<NODE*>* link, vector<CloneTask>& tasks)
+	{
+		if(orig == nullptr)
+			return nullptr;
 		
-		bool goRight = false;
-		bool goLeft = false;
-
-		while (cur != nullptr)
-		{  
-			if (key == cur->Key)  // already in tree
-				return;
-				
-			else if (key < cur->Key)  // search left:
-			{
-				prev = cur;
-				cur = cur->Left;
-				if(cur == nullptr)  // if cur is nullptr after moving left, it shouldnt be trying
-					goLeft = true;    // to insert on the left side of this. it just fell out
-			}
-			else  //search right
-			{
-				if(cur->isThreaded) // if it hits this point and it's threaded and the key is greater
-				{                   // than the current node, it wont go back up the tree. it will
-					prev = cur;       // just insert on the right and make it unthreaded
-					cur = nullptr;
-					goRight = true;
-					break;
-				}
-				else 
-				{	
-					prev = cur;
-					cur = cur->Right;
-					if(cur == nullptr) // if cur is nullptr after moving right, it shouldnt be trying
-						goRight = true;  // to insert on the right of this. it just fell out here
-				}
-					
-			}
-			
-		} //while
+		if(depth == 0)
+		{
+			CloneTask task = { orig, after, link, 0, nullptr };
+			tasks.push_back(task);
+			return nullptr;
+		}
+		
+		NODE* node = createNode(orig->Key, orig->Value);
+		node->Height = orig->Height;
+		copyCount(node, orig);
+		*link = node;
+		node->Left = cloneTop(orig->Left, node, depth - 1, &node->Left, tasks);
+		linkCloneRight(orig, node, after);
+		if(orig->isThreaded || orig->Right == nullptr)
+			node->Right = after;
+		else
+			node->Right = cloneTop(orig->Right, after, depth - 1, &node->Right, tasks);
+		return node;
+	}
+	
+	/* countNodes()
+	 * 
+	 * # of nodes in the subtree rooted at node
+	 */
+	
+	static size_t countNodes(const NODE* node)
+	{
+		size_t count = 0;
+		while(node != nullptr)
+		{
+			count += 1 + countNodes(node->Left);
+			node = node->isThreaded ? nullptr : node->Right;
+		}
+		return count;
+	}
+	
+	/* cloneInto()
+	 * 
+	 * same as cloneTree(), but builds the nodes one after the other in
+	 * storage that was already set aside, so workers never touch the pool
+	 */
+	
+	static NODE* cloneInto(const NODE* orig, NODE* after, unsigned char*& slots)
+	{
+		if(orig == nullptr)
+			return nullptr;
+		
+		NODE* node = ::new (static_cast<void*>(slots)) NODE(orig->Key, std::piecewise_construct, orig->Value);
+		node->Height = orig->Height;
+		copyCount(node, orig);
+		slots += NodePool::SlotSize;
+		node->Left = cloneInto(orig->Left, node, slots);
+		linkCloneRight(orig, node, after);
+		node->Right = (orig->isThreaded || orig->Right == nullptr) ? after : cloneInto(orig->Right, after, slots);
+		return node;
+	}
+	
+	/* cloneParallel()
+	 * 
+	 * copies a tree using several threads. The top levels are copied here,
+	 * and the subtrees below them are sized, given one contiguous block of
+	 * storage, and copied by the workers. Only used when copying a key or
+	 * value can't throw, since a worker has no way to back out.
+	 */
+	
+	NODE* cloneParallel(const NODE* orig, unsigned threads)
+	{
+		LinkField<NODE*> root(nullptr);
+		vector<CloneTask> tasks;
 		
+		int depth = 2;  // about 4 subtrees per thread keeps the workers even
+		while((1u << (depth - 2)) < threads)
+			depth++;
 		
+		cloneTop(orig, nullptr, depth, &root, tasks);
+		if(tasks.empty())
+			return root;
 		
+		runTasks(tasks, threads, [](CloneTask& task) {
+			task.Count = countNodes(task.Orig);
+		});
 		
-		// creating new node to insert in the tree...
-		NODE* newNode = new NODE();
-
-		newNode->Key = key;
-		newNode->Value = value;
-		newNode->Left = nullptr;
-		newNode->Right = nullptr;
-		newNode->Height = height;
+		size_t total = 0;
+		for(size_t i = 0; i < tasks.size(); i++)
+			total += tasks[i].Count;
 		
-		// Determining if its a new tree,
-		if (prev == nullptr)
+		unsigned char* block = Pool.allocate_block(total);
+		for(size_t i = 0; i < tasks.size(); i++)
 		{
-		   Root = newNode;
-			 ogRoot = Root;
+			tasks[i].Slots = block;
+			block += tasks[i].Count * NodePool::SlotSize;
 		}
 		
-		// or a new node thats to the left of where it fell out,
-		if(goLeft)
+		runTasks(tasks, threads, [](CloneTask& task) {
+			unsigned char* slots = task.Slots;
+			*task.Link = cloneInto(task.Orig, task.After, slots);
+		});
+		statAlloc(total);  // the workers' nodes; the top ones came through createNode()
+		
+		return root;
+	}
+	
+	/* runTasks()
+	 * 
+	 * runs fn over every task, with the tasks dealt out to "threads" threads
+	 */
+	
+	template<typename Fn>
+	static void runTasks(vector<CloneTask>& tasks, unsigned threads, Fn fn)
+	{
+		vector<std::thread> workers;
+		
+		for(unsigned t = 1; t < threads; t++)
 		{
-			newNode->Right = prev;
-			prev->Left = newNode;
-			newNode->isThreaded = true;
+			workers.push_back(std::thread([&tasks, threads, t, fn]() {
+				for(size_t i = t; i < tasks.size(); i += threads)
+					fn(tasks[i]);
+			}));
 		}
 		
-		// or a node to the right of where it fell out.
-		if(goRight)
+		for(size_t i = 0; i < tasks.size(); i += threads)
+			fn(tasks[i]);
+		
+		for(size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+	
+	/* buildBalanced()
+	 * 
+	 * builds a perfectly balanced subtree out of the next "count" distinct
+	 * keys of a sorted (key, value) sequence, creating the nodes in order.
+	 * "pending" is the last node built that has no right child yet; the
+	 * next node created is its in-order successor, so it gets threaded to
+	 * that node. Duplicate keys keep the first value, like insert().
+	 */
+	
+	template<typename It>
+	NODE* buildBalanced(It& it, It last, size_t count, NODE*& pending)
+	{
+		if(count == 0)
+			return nullptr;
+		
+		size_t leftCount = count / 2;
+		NODE* left = buildBalanced(it, last, leftCount, pending);
+		
+		NODE* node = createNode(it->first, it->second);
+		const KeyT& key = it->first;
+		++it;
+		while(it != last && !Less(key, it->first))  // skip duplicates of key
+			++it;
+		
+		if(pending != nullptr)
 		{
-			newNode->Right = prev->Right;
-			prev->Right = newNode;
-			//nodes.push(newNode);
-			prev->isThreaded = false;     // dethreaded prev if it is going to be inserted on the right of prev
-			
-			if(newNode->Right != nullptr) // if prev was pointing at something, it uses its right to point there
-				newNode->isThreaded = true;
-			else
-				newNode->isThreaded = false; // and if it wasn't, then it just makes 
-		}                                // it null (could be on the right of the tree)
+			pending->Right = node;
+			pending->isThreaded = true;
+		}
+		pending = nullptr;
 		
-		Size++;
+		node->Left = left;
+		node->Right = buildBalanced(it, last, count - leftCount - 1, pending);
+		if(node->Right == nullptr)
+			pending = node;
+		
+		node->Height = 1 + max(assignHeight(node->Left), assignHeight(node->Right));
+		assignCount(node);
+		return node;
+	}
+	
+	/* countSorted()
+	 * 
+	 * counts the distinct keys of a (key, value) sequence, or returns
+	 * false if the keys turn out not to be in ascending order
+	 */
+	
+	template<typename It>
+	bool countSorted(It first, It last, size_t& count) const
+	{
+		count = 0;
+		if(first == last)
+			return true;
 		
+		It prev = first;
+		count = 1;
+		for(++first; first != last; ++first)
+		{
+			if(Less(first->first, prev->first))
+				return false;
+			if(Less(prev->first, first->first))
+				count++;
+			prev = first;
+		}
+		return true;
 	}
 	
 	// inOrder()
@@ -174,10 +723,53 @@ private:
 	
 
 	
-	// clearTree()
+	/* createNode() / emplaceNode()
+	 * 
+	 * builds a new unlinked leaf in storage from the pool. emplaceNode()
+	 * moves the key in if it can and constructs the value straight in the
+	 * node from args. If that throws, the storage goes back to the pool.
+	 */
+	
+	NODE* createNode(const KeyT& key, const ValueT& value)
+	{
+		return emplaceNode(key, value);
+	}
+	
+	template<typename K, typename... Args>
+	NODE* emplaceNode(K&& key, Args&&... args)
+	{
+		void* slot = Pool.allocate();
+		try
+		{
+			NODE* node = ::new (slot) NODE(std::forward<K>(key), std::piecewise_construct, std::forward<Args>(args)...);
+			statAlloc(1);
+			return node;
+		}
+		catch(...)
+		{
+			Pool.deallocate(static_cast<NODE*>(slot));
+			throw;
+		}
+	}
+	
+	/* destroyNode()
+	 * 
+	 * destroys a single node and gives its storage back to the pool,
+	 * where the next insert will reuse it
+	 */
+	
+	void destroyNode(NODE* node)
+	{
+		node->~NODE();
+		Pool.deallocate(node);
+		statFree(1);
+	}
+	
+	// clearTree()
 	// 
 	// function to clear the entire tree by recursively going from left to right
-	// through the tree and then deleting the node before returning
+	// through the tree and running each node's destructor. The memory itself
+	// is not freed here, it goes back all at once with the pool's slabs.
 	//  
 	void clearTree(NODE* node)
 	{
@@ -186,12 +778,29 @@ private:
 			clearTree(node->Left);
 			if(!node->isThreaded)
 				clearTree(node->Right);
-			delete node;
+			node->~NODE();
 		}
 		
 		return;
 	}
 	
+	/* releaseAll()
+	 * 
+	 * destroys every node and hands all slabs back to the allocator.
+	 * when both KeyT and ValueT are trivially destructible there is
+	 * nothing to run per node, so the tree isn't walked at all.
+	 */
+	
+	void releaseAll()
+	{
+		if(!(std::is_trivially_destructible<KeyT>::value &&
+		     std::is_trivially_destructible<ValueT>::value))
+			clearTree(ogRoot);
+		
+		Pool.release();
+		statFree(Size);
+	}
+	
 	/* assignHeight()
 	 * 
 	 * helper function to determine the height
@@ -205,6 +814,141 @@ private:
 			return node->Height;
 	}
 	
+	/* subtreeCount() / assignCount() / addCount() / copyCount()
+	 * 
+	 * upkeep of the subtree sizes kept with AVLT_ORDER_STATISTICS; they
+	 * do nothing (and subtreeCount() is never called) without it.
+	 * assignCount() recomputes a node's size from its children, the way
+	 * the rotations recompute heights.
+	 */
+	
+	static int subtreeCount(const NODE* node)
+	{
+#ifdef AVLT_ORDER_STATISTICS
+		return (node == nullptr) ? 0 : node->Count;
+#else
+		(void) node;
+		return 0;
+#endif
+	}
+	
+	static void assignCount(NODE* node)
+	{
+#ifdef AVLT_ORDER_STATISTICS
+		node->Count = 1 + subtreeCount(node->Left) + (node->isThreaded ? 0 : subtreeCount(node->Right));
+#else
+		(void) node;
+#endif
+	}
+	
+	static void addCount(NODE* node, int delta)
+	{
+#ifdef AVLT_ORDER_STATISTICS
+		node->Count += delta;
+#else
+		(void) node;
+		(void) delta;
+#endif
+	}
+	
+	static void copyCount(NODE* node, const NODE* from)
+	{
+#ifdef AVLT_ORDER_STATISTICS
+		node->Count = from->Count;
+#else
+		(void) node;
+		(void) from;
+#endif
+	}
+	
+	/* statRotation() / statRebalance() / statPath() / statLookup() / ...
+	 * 
+	 * the counting behind stats(); like the count upkeep above they do
+	 * nothing without AVLT_STATS. Lengths past the last histogram entry
+	 * are counted in it.
+	 */
+	
+#ifdef AVLT_STATS
+	static void statBucket(std::atomic<unsigned long long>* histogram, int length)
+	{
+		if(length >= avlt_stats::Buckets)
+			length = avlt_stats::Buckets - 1;
+		histogram[length].fetch_add(1, std::memory_order_relaxed);
+	}
+#endif
+	
+	void statRotation() const
+	{
+#ifdef AVLT_STATS
+		Stats.Rotations.fetch_add(1, std::memory_order_relaxed);
+#endif
+	}
+	
+	void statInsert(size_t count) const
+	{
+#ifdef AVLT_STATS
+		Stats.Inserts.fetch_add(count, std::memory_order_relaxed);
+#else
+		(void) count;
+#endif
+	}
+	
+	void statRebalance(int steps) const
+	{
+#ifdef AVLT_STATS
+		statBucket(Stats.RebalanceDepths, steps);
+#else
+		(void) steps;
+#endif
+	}
+	
+	void statPath(int length) const
+	{
+#ifdef AVLT_STATS
+		statBucket(Stats.PathLengths, length);
+#else
+		(void) length;
+#endif
+	}
+	
+	// a lookup descent through "length" nodes, one comparison each
+	void statLookup(int length) const
+	{
+#ifdef AVLT_STATS
+		Stats.Searches.fetch_add(1, std::memory_order_relaxed);
+		Stats.SearchComparisons.fetch_add(length, std::memory_order_relaxed);
+		statPath(length);
+#else
+		(void) length;
+#endif
+	}
+	
+	// the equality check some lookups make at the bottom
+	void statComparison() const
+	{
+#ifdef AVLT_STATS
+		Stats.SearchComparisons.fetch_add(1, std::memory_order_relaxed);
+#endif
+	}
+	
+	void statAlloc(size_t count) const
+	{
+#ifdef AVLT_STATS
+		Stats.NodeAllocations.fetch_add(count, std::memory_order_relaxed);
+#else
+		(void) count;
+#endif
+	}
+	
+	void statFree(size_t count) const
+	{
+#ifdef AVLT_STATS
+		Stats.NodeFrees.fetch_add(count, std::memory_order_relaxed);
+#else
+		(void) count;
+#endif
+	}
+	
 	/* right_rotate()
 	 * 
 	 * Helper function for insert/checkBalance to rotate the tree
@@ -251,16 +995,15 @@ private:
 			curRightHeight = assignHeight(cur->Right);
     cur->Height = max(hclRL, curRightHeight) + 1;
 		
-		if(!cl->isThreaded){
-			clRight = assignHeight(cl->Right);
-		}
-		else {
-			clRight = -1;
-			cl->isThreaded = false;
-		}
+		clRight = cur->Height;  // cl->Right is cur now, even if it used to be a thread
+		cl->isThreaded = false;
 		
     cl->Height = max(clLeft, clRight) + 1;  
 		
+		assignCount(cur);
+		assignCount(cl);
+		statRotation();
+		
 		//update parent
 		if(par == nullptr){
 			Root = cl;
@@ -321,13 +1064,17 @@ void left_rotate(NODE* cur, NODE* par)
     cur->Height = max(hcrLR, assignHeight(cur->Left)) + 1;
 		crLeft = assignHeight(cr->Left);
 		
-		if(cur->isThreaded)
+		if(cr->isThreaded)
 			crRight = -1;
 		else
 			crRight = assignHeight(cr->Right);
 			
     cr->Height = max(crLeft, crRight) + 1;  
 		
+		assignCount(cur);
+		assignCount(cr);
+		statRotation();
+		
 		//update parent
 		if(par == nullptr){
 			Root = cr;
@@ -349,30 +1096,26 @@ void left_rotate(NODE* cur, NODE* par)
 	/* checkBalance()
 	 * 
 	 * Helper function for insert to check the balance of the nodes
-	 * after a new one is inserted. it's passed a stack from insert
-	 * from all the nodes it had to access to insert the new node.
+	 * after a new one is inserted. it's passed the array from insert
+	 * of all the nodes it had to access to insert the new node, root
+	 * first, which lives on insert's stack frame so nothing is allocated.
 	 * 
-	 * it goes through the whole stack checking the height of the children
+	 * it goes back up through the whole path checking the height of the children
 	 * and if they differ by too much, it will rotate accordingly based on 
 	 * the position the nodes are in and where they differ
 	 */
 
-void checkBalance(stack<NODE*>& nodes, KeyT key)
+void checkBalance(NODE** path, int depth, const KeyT& key)
 	{
 		NODE* cur = nullptr;
 		NODE* prev = nullptr;
+		int steps = 0;  // ancestors looked at, for stats()
 		
-		while (!nodes.empty())
+		for (int i = depth - 1; i >= 0; i--)
     {
-      cur = nodes.top();
-			if(cur == nullptr)
-				break;
-
-      nodes.pop();
-			if(!nodes.empty())
-				prev = nodes.top();
-			else 
-				prev = nullptr;
+      cur = path[i];
+			prev = (i > 0) ? path[i - 1] : nullptr;
+			steps++;
 			
       int hL;
 			int hR;
@@ -398,70 +1141,1475 @@ void checkBalance(stack<NODE*>& nodes, KeyT key)
 			//find balance and rotate accordingly
 			int balance = hL - hR;
 			
-			if(balance >= 2 && key < cur->Left->Key)       //Right Rotate
+			if(balance >= 2 && Less(key, cur->Left->Key))       //Right Rotate
 			{
 				right_rotate(cur, prev);
 			}
-			else if(balance <= -2 && key > cur->Right->Key)     //Left Rotate
+			else if(balance <= -2 && Less(cur->Right->Key, key))     //Left Rotate
 			{
 				left_rotate(cur, prev);
 			}
-			else if(balance >= 2 && key > cur->Left->Key)       //Left Right Rotate
+			else if(balance >= 2 && Less(cur->Left->Key, key))       //Left Right Rotate
 			{
 				left_rotate(cur->Left, cur);
 				right_rotate(cur, prev);	
 			}
-			else if(balance <= -2 && key < cur->Right->Key)       //Right Left Rotate
+			else if(balance <= -2 && Less(key, cur->Right->Key))       //Right Left Rotate
 			{
 				right_rotate(cur->Right, cur);
 				left_rotate(cur, prev);
 			}
 			
-		} //while
+		} //for
+		
+		statRebalance(steps);
 	}
 	
-	/* nextRange(NODE* node)
+	/* uncount()
 	 * 
-	 * helper function for the search_range function.
-	 * returns the next node by increasing key order to the 
-	 * search_range function. First it movesd right, then it sees if
-	 * it can move left while the keys are not equal to the original
-	 * node's key
+	 * helper function for insert, which counts the new node in each
+	 * ancestor's subtree size on the way down. if the key turns out to be
+	 * there already, this takes those counts back.
+	 */
+	
+	void uncount(NODE** path, int depth)
+	{
+		for(int i = 0; i < depth; i++)
+			addCount(path[i], -1);
+	}
+	
+	/* insertNode()
+	 * 
+	 * the descent and linking behind insert(), try_emplace() and
+	 * insert_or_assign(). Looks for key and, if it isn't there, links in
+	 * the node make() builds for it and rebalances. make() is only called
+	 * once the key is known to be missing, so nothing is built for a key
+	 * that's already there. Returns key's node and whether it's new.
 	 */
+	
+	template<typename Make>
+	pair<NODE*, bool> insertNode(const KeyT& key, Make make)
+	{
+		NODE* prev = nullptr;
+		NODE* cur = ogRoot;
+		NODE* lower = nullptr;  // first node >= key so far, as in lowerNode()
+		NODE* path[MaxPath];    // nodes on the way down, root first
+		int depth = 0;
+		
+		bool goRight = false;
+		bool goLeft = false;
+	
+		
+		while (cur != nullptr)
+		{  
+			addCount(cur, 1);  // the new node will be below cur
+			
+			if (!Less(cur->Key, key))  // search left, key <= cur->Key:
+			{
+				lower = cur;
+				prev = cur;
+				path[depth++] = cur;
+				cur = cur->Left;
+				if(cur == nullptr)  // if cur is nullptr after moving left, it shouldnt be trying
+					goLeft = true;    // to insert on the left side of this. it just fell out
+			}
+			else  //search right
+			{
+				if(cur->isThreaded) // if it hits this point and it's threaded and the key is greater
+				{                   // than the current node, it wont go back up the tree. it will
+					prev = cur;       // just insert on the right and make it unthreaded
+					path[depth++] = cur;
+					cur = nullptr;
+					goRight = true;
+					break;
+				}
+				else 
+				{
+					
+					prev = cur;
+					path[depth++] = cur;
+					cur = cur->Right;
+					if(cur == nullptr) // if cur is nullptr after moving right, it shouldnt be trying
+						goRight = true;  // to insert on the right of this. it just fell out here
+				}
+					
+			}
+			
+		} //while
+		
+		statPath(depth);
+		
+		if (lower != nullptr && !Less(key, lower->Key))  // already in tree
+		{
+			uncount(path, depth);
+			return make_pair(lower, false);
+		}
+		
+		// creating new node to insert in the tree...
+		NODE* newNode;
+		try
+		{
+			newNode = make();
+		}
+		catch(...)
+		{
+			uncount(path, depth);
+			throw;
+		}
+		
+		// Determining if its a new tree,
+		if (prev == nullptr)
+		{
+		   Root = newNode;
+			 ogRoot = Root;
+			 //nodes.push(newNode);
+		}
+		
+		// or a new node thats to the left of where it fell out,
+		if(goLeft)
+		{
+			newNode->Right = prev;
+			prev->Left = newNode;
+			//nodes.push(newNode);
+			newNode->isThreaded = true;
+		}
+		
+		// or a node to the right of where it fell out.
+		if(goRight)
+		{
+			newNode->Right = prev->Right;
+			prev->Right = newNode;
+			//nodes.push(newNode);
+			prev->isThreaded = false;     // dethreaded prev if it is going to be inserted on the right of prev
+			
+			if(newNode->Right != nullptr) // if prev was pointing at something, it uses its right to point there
+				newNode->isThreaded = true;
+			else
+				newNode->isThreaded = false; // and if it wasn't, then it just makes 
+		}                                // it null (could be on the right of the tree)
+		
+		Size++;
+		statInsert(1);
+		
+		// balance time
 		
-	NODE* nextRange(NODE* node)
+		checkBalance(path, depth, newNode->Key);  // key may have been moved into the node
+		return make_pair(newNode, true);
+	}
+	
+	/* PathStep
+	 * 
+	 * one ancestor on the way down to an insert position, along with the
+	 * key its whole subtree stays below (nullptr if there's no such key,
+	 * meaning the subtree runs to the end of the tree)
+	 */
+	
+	struct PathStep
 	{
-		if(node == nullptr){
-			return node;
+		NODE*       Node;
+		const KeyT* Upper;
+	};
+	
+	// # of descents search_many keeps in flight at once
+	static constexpr size_t SearchGroup = 16;
+	
+	// insert_batch relinks the whole tree once batch * RebuildRatio >= N
+	static const size_t RebuildRatio = 8;
+	
+	// AVL height is at most ~1.44*lg(N+2), so this covers any int-sized tree
+	static const int MaxPath = 64;
+	
+	/* insertFromPath()
+	 * 
+	 * helper function for insert_batch. Inserts key like insert() does,
+	 * but instead of starting at the root it picks the descent up from the
+	 * deepest ancestor left in "path" whose subtree can still hold the key,
+	 * since consecutive keys of a sorted batch land close together. Keys
+	 * must come in ascending order. Afterwards path holds the ancestors of
+	 * the new node that are still valid after any rotations.
+	 */
+	
+	void insertFromPath(PathStep* path, int& depth, const KeyT& key, const ValueT& value)
+	{
+		// drop the ancestors whose subtree ends at or before key
+		while(depth > 0 && path[depth - 1].Upper != nullptr && !Less(key, *path[depth - 1].Upper))
+			depth--;
+		
+		NODE* cur = ogRoot;
+		const KeyT* upper = nullptr;
+		if(depth > 0)  // resume from the deepest ancestor that still holds key
+		{
+			depth--;
+			cur = path[depth].Node;
+			upper = path[depth].Upper;
 		}
-
-		KeyT key = node->Key;
-		node = node->Right;
 		
-		if(node != nullptr){
-			while(node->Left != nullptr && node->Left->Key > key)
+		NODE* prev = nullptr;
+		bool goLeft = false;
+		int visited = 0;  // for stats()
+		
+		while(cur != nullptr)
+		{
+			path[depth].Node = cur;
+			path[depth].Upper = upper;
+			depth++;
+			prev = cur;
+			visited++;
+			
+			if(!Less(cur->Key, key))  // search left, key <= cur->Key:
 			{
-				node = node->Left;
+				upper = &cur->Key;
+				cur = cur->Left;
+				goLeft = true;
+			}
+			else  // search right, unless it's a thread or the end of the tree
+			{
+				cur = cur->isThreaded ? nullptr : cur->Right;
+				goLeft = false;
 			}
 		}
-		return node;
+		statPath(visited);
+		
+		// upper is the smallest key on the way that isn't below key, so
+		// key is already in the tree exactly when it isn't above upper
+		if(upper != nullptr && !Less(key, *upper))
+			return;
+		
+		NODE* newNode = createNode(key, value);
+		
+		if(prev == nullptr)  // new tree
+		{
+			Root = newNode;
+			ogRoot = Root;
+		}
+		else if(goLeft)
+		{
+			newNode->Right = prev;
+			newNode->isThreaded = true;
+			prev->Left = newNode;
+		}
+		else
+		{
+			newNode->Right = prev->Right;
+			newNode->isThreaded = (prev->Right != nullptr);
+			prev->Right = newNode;
+			prev->isThreaded = false;
+		}
+		
+		Size++;
+		statInsert(1);
+		for(int i = 0; i < depth; i++)
+			addCount(path[i].Node, 1);
+		
+		// same walk as checkBalance
+		int steps = 0;
+		for(int i = depth - 1; i >= 0; i--)
+		{
+			NODE* node = path[i].Node;
+			NODE* par = (i > 0) ? path[i - 1].Node : nullptr;
+			steps++;
+			
+			int hL = assignHeight(node->Left);
+			int hR = node->isThreaded ? -1 : assignHeight(node->Right);
+			int hCur = 1 + max(hL, hR);
+			
+			if(node->Height == hCur)  // didn't change, so no need to go further
+				break;
+			node->Height = hCur;
+			
+			int balance = hL - hR;
+			if(balance >= -1 && balance <= 1)
+				continue;
+			
+			if(balance >= 2 && Less(key, node->Left->Key))            //Right Rotate
+				right_rotate(node, par);
+			else if(balance <= -2 && Less(node->Right->Key, key))     //Left Rotate
+				left_rotate(node, par);
+			else if(balance >= 2)                                //Left Right Rotate
+			{
+				left_rotate(node->Left, node);
+				right_rotate(node, par);
+			}
+			else                                                 //Right Left Rotate
+			{
+				right_rotate(node->Right, node);
+				left_rotate(node, par);
+			}
+			
+			depth = i;  // the rotated nodes moved, everything above them stays put
+			statRebalance(steps);
+			return;
+		}
+		statRebalance(steps);
 	}
 	
-public:
-
-  //
-  // default constructor:
-  //
-  // Creates an empty tree.
-  //
-  avlt()
-  {
-    Root = nullptr;
-    Size = 0;
-		ogRoot = nullptr;
-		hasBegun = false;
-  }
+	/* rebuildMerged()
+	 * 
+	 * helper function for insert_batch. Merges the sorted batch into the
+	 * tree by walking the tree's nodes in order along the threads next to
+	 * the batch, then relinks the old and new nodes into a perfectly
+	 * balanced tree. Existing nodes are reused, only the new keys allocate.
+	 */
 	
+	void rebuildMerged(const vector<pair<KeyT, ValueT>>& batch)
+	{
+		vector<NODE*> nodes;
+		nodes.reserve(Size + batch.size());
+		
+		NODE* cur = ogRoot;
+		while(cur != nullptr && cur->Left != nullptr)
+			cur = cur->Left;
+		
+		size_t i = 0;
+		while(cur != nullptr || i < batch.size())
+		{
+			if(i < batch.size() && (cur == nullptr || Less(batch[i].first, cur->Key)))
+			{
+				nodes.push_back(createNode(batch[i].first, batch[i].second));
+				const KeyT& key = batch[i].first;
+				for(i++; i < batch.size() && !Less(key, batch[i].first); i++)
+					;  // later copies of a key lose, like insert()
+			}
+			else
+			{
+				for(; i < batch.size() && !Less(cur->Key, batch[i].first); i++)
+					;  // already in the tree
+				nodes.push_back(cur);
+				cur = nextRange(cur);
+			}
+		}
+		
+		NODE* pending = nullptr;
+		Root = linkBalanced(nodes.data(), nodes.size(), pending);
+		ogRoot = Root;
+		statInsert(nodes.size() - Size);
+		Size = (int) nodes.size();
+	}
+	
+	/* linkBalanced()
+	 * 
+	 * same as buildBalanced(), but relinks nodes that already exist,
+	 * given in key order
+	 */
+	
+	NODE* linkBalanced(NODE** nodes, size_t count, NODE*& pending)
+	{
+		if(count == 0)
+			return nullptr;
+		
+		size_t leftCount = count / 2;
+		NODE* node = nodes[leftCount];
+		node->Left = linkBalanced(nodes, leftCount, pending);
+		
+		if(pending != nullptr)
+		{
+			pending->Right = node;
+			pending->isThreaded = true;
+		}
+		pending = nullptr;
+		
+		node->Right = linkBalanced(nodes + leftCount + 1, count - leftCount - 1, pending);
+		node->isThreaded = false;
+		if(node->Right == nullptr)
+			pending = node;
+		
+		node->Height = 1 + max(assignHeight(node->Left), assignHeight(node->Right));
+		assignCount(node);
+		return node;
+	}
+	
+	/* rightHeight()
+	 * 
+	 * height of a node's right subtree, -1 if its Right is only a thread
+	 */
+	
+	int rightHeight(NODE* node)
+	{
+		return node->isThreaded ? -1 : assignHeight(node->Right);
+	}
+	
+	/* rebalanceUp()
+	 * 
+	 * Helper function for erase. Walks back up the ancestors in path,
+	 * fixing heights and rotating wherever a side got too short. Unlike
+	 * after an insert, a rotation can shrink the subtree, so the walk only
+	 * stops once a node's height comes out unchanged and it is balanced.
+	 */
+	
+	void rebalanceUp(NODE** path, int depth)
+	{
+		for(int i = depth - 1; i >= 0; i--)
+		{
+			NODE* cur = path[i];
+			NODE* par = (i > 0) ? path[i - 1] : nullptr;
+			
+			int hL = assignHeight(cur->Left);
+			int hR = rightHeight(cur);
+			int hCur = 1 + max(hL, hR);
+			int balance = hL - hR;
+			
+			if(balance >= 2)
+			{
+				NODE* cl = cur->Left;
+				if(assignHeight(cl->Left) < rightHeight(cl))  //Left Right Rotate
+					left_rotate(cl, cur);
+				right_rotate(cur, par);                       //Right Rotate
+			}
+			else if(balance <= -2)
+			{
+				NODE* cr = cur->Right;
+				if(assignHeight(cr->Left) > rightHeight(cr))  //Right Left Rotate
+					right_rotate(cr, cur);
+				left_rotate(cur, par);                        //Left Rotate
+			}
+			else if(cur->Height == hCur)  // didn't change, so no need to go further
+				break;
+			else
+				cur->Height = hCur;
+		}
+	}
+	
+	/* leftmost()
+	 * 
+	 * first inorder node of the subtree rooted at node
+	 */
+	
+	static NODE* leftmost(NODE* node)
+	{
+		if(node != nullptr)
+			while(node->Left != nullptr)
+				node = node->Left;
+		return node;
+	}
+	
+	/* successor()
+	 * 
+	 * next inorder node after node, without looking at any keys: either
+	 * the thread, or the first node of the right subtree
+	 */
+	
+	static NODE* successor(NODE* node)
+	{
+		if(node->isThreaded)
+			return node->Right;
+		return leftmost(node->Right);
+	}
+	
+	/* nextRange(NODE* node)
+	 * 
+	 * helper function for the search_range function.
+	 * returns the next node by increasing key order to the 
+	 * search_range function. First it movesd right, then, unless that
+	 * was a thread, it moves left as far as it can. Only the thread flag
+	 * is needed for that, no keys are compared.
+	 */
+		
+	NODE* nextRange(NODE* node) const
+	{
+		if(node == nullptr){
+			return node;
+		}
+
+		bool thread = node->isThreaded;
+		node = node->Right;
+		
+		if(node != nullptr && !thread){
+			while(node->Left != nullptr)
+			{
+				node = node->Left;
+			}
+		}
+		return node;
+	}
+	
+	/* subtreeHeight() / rightChild() / fixNode()
+	 * 
+	 * helpers for the join-based set operations below, which work on
+	 * detached subtrees. A detached subtree's rightmost node may still
+	 * be threaded to whatever followed it before, so its Right is only
+	 * followed through rightChild(). fixNode() recomputes a node's height
+	 * (and size) from its children.
+	 */
+	
+	static int subtreeHeight(const NODE* node)
+	{
+		return (node == nullptr) ? -1 : node->Height;
+	}
+	
+	static NODE* rightChild(NODE* node)
+	{
+		return node->isThreaded ? nullptr : node->Right;
+	}
+	
+	static void fixNode(NODE* node)
+	{
+		node->Height = 1 + max(subtreeHeight(node->Left), subtreeHeight(rightChild(node)));
+		assignCount(node);
+	}
+	
+	/* rotateLeftOf() / rotateRightOf()
+	 * 
+	 * same rotations as left_rotate() / right_rotate(), but of a detached
+	 * subtree: they return the subtree's new root instead of relinking a
+	 * parent
+	 */
+	
+	NODE* rotateRightOf(NODE* node) const
+	{
+		NODE* left = node->Left;
+		node->Left = rightChild(left);  // a thread from left back to node isn't a child
+		left->Right = node;
+		left->isThreaded = false;
+		fixNode(node);
+		fixNode(left);
+		statRotation();
+		return left;
+	}
+	
+	NODE* rotateLeftOf(NODE* node) const
+	{
+		NODE* right = rightChild(node);
+		node->Right = right->Left;
+		node->isThreaded = (node->Right == nullptr);
+		if(node->isThreaded)  // right is next after node now
+			node->Right = right;
+		right->Left = node;
+		fixNode(node);
+		fixNode(right);
+		statRotation();
+		return right;
+	}
+	
+	/* joinNodes()
+	 * 
+	 * the AVL join: returns a balanced subtree of the nodes of left, then
+	 * node, then the nodes of right, given every key in left is below
+	 * node's and every key in right above it. Takes time proportional to
+	 * the difference in height of left and right, since node is hung off
+	 * the taller one's spine where the heights meet and only the path
+	 * above it is rebalanced.
+	 * 
+	 * The rightmost node of left must already be threaded to node; see
+	 * joinThreaded(). Where node ends up with no right child it is
+	 * threaded to the first node of right.
+	 */
+	
+	// a node that comes last keeps its old Right as a thread: splitNodes()
+	// and splitLast() count on the last node of a left piece still being
+	// threaded to the node that followed it in the original subtree
+	static void setRightChild(NODE* node, NODE* right)
+	{
+		if(right != nullptr)
+		{
+			node->Right = right;
+			node->isThreaded = false;
+		}
+		else
+			node->isThreaded = true;
+	}
+	
+	NODE* joinNodes(NODE* left, NODE* node, NODE* right) const
+	{
+		if(subtreeHeight(left) > subtreeHeight(right) + 1)
+			return joinRight(left, node, right);
+		if(subtreeHeight(right) > subtreeHeight(left) + 1)
+			return joinLeft(left, node, right);
+		
+		node->Left = left;
+		setRightChild(node, right);
+		fixNode(node);
+		return node;
+	}
+	
+	// joinNodes() when left is the taller: node goes down left's right spine
+	NODE* joinRight(NODE* left, NODE* node, NODE* right) const
+	{
+		NODE* spine = rightChild(left);
+		NODE* joined;
+		
+		if(subtreeHeight(spine) <= subtreeHeight(right) + 1)
+		{
+			node->Left = spine;
+			setRightChild(node, right);
+			fixNode(node);
+			joined = node;
+			
+			if(subtreeHeight(joined) > subtreeHeight(left->Left) + 1)
+				joined = rotateRightOf(joined);
+		}
+		else
+			joined = joinRight(spine, node, right);
+		
+		left->Right = joined;
+		left->isThreaded = false;
+		fixNode(left);
+		
+		if(subtreeHeight(joined) > subtreeHeight(left->Left) + 1)
+			return rotateLeftOf(left);
+		return left;
+	}
+	
+	// joinNodes() when right is the taller: node goes down right's left spine
+	NODE* joinLeft(NODE* left, NODE* node, NODE* right) const
+	{
+		NODE* spine = right->Left;
+		NODE* joined;
+		
+		if(subtreeHeight(spine) <= subtreeHeight(left) + 1)
+		{
+			node->Left = left;
+			node->Right = (spine != nullptr) ? spine : right;  // right is next after node if it has no left
+			node->isThreaded = (spine == nullptr);
+			fixNode(node);
+			joined = node;
+			
+			if(subtreeHeight(joined) > subtreeHeight(rightChild(right)) + 1)
+				joined = rotateLeftOf(joined);
+		}
+		else
+			joined = joinLeft(left, node, spine);
+		
+		right->Left = joined;
+		fixNode(right);
+		
+		if(subtreeHeight(joined) > subtreeHeight(rightChild(right)) + 1)
+			return rotateRightOf(right);
+		return right;
+	}
+	
+	/* joinThreaded()
+	 * 
+	 * joinNodes() for a left that was built apart from node: first
+	 * threads left's rightmost node to node
+	 */
+	
+	NODE* joinThreaded(NODE* left, NODE* node, NODE* right) const
+	{
+		if(left != nullptr)
+		{
+			NODE* last = left;
+			while(rightChild(last) != nullptr)
+				last = rightChild(last);
+			last->Right = node;
+			last->isThreaded = true;
+		}
+		return joinNodes(left, node, right);
+	}
+	
+	/* splitNodes()
+	 * 
+	 * splits the detached subtree under node around key: lower gets the
+	 * nodes below key, upper the ones above, and found key's own node, or
+	 * nullptr if it isn't there. Rejoins one subtree per level on the way
+	 * back up, so it takes O(lgN) time. Each left subtree joined back in
+	 * here is still threaded to the node it's joined to.
+	 */
+	
+	void splitNodes(NODE* node, const KeyT& key, NODE*& lower, NODE*& found, NODE*& upper) const
+	{
+		if(node == nullptr)
+		{
+			lower = found = upper = nullptr;
+			return;
+		}
+		
+		NODE* left = node->Left;
+		NODE* right = rightChild(node);
+		
+		if(Less(key, node->Key))
+		{
+			splitNodes(left, key, lower, found, upper);
+			upper = joinNodes(upper, node, right);
+		}
+		else if(Less(node->Key, key))
+		{
+			splitNodes(right, key, lower, found, upper);
+			lower = joinNodes(left, node, lower);
+		}
+		else
+		{
+			lower = left;
+			found = node;
+			upper = right;
+		}
+	}
+	
+	/* splitLast() / joinPair()
+	 * 
+	 * joinPair() joins two detached subtrees with nothing in between,
+	 * by taking the last node out of left (splitLast) to go in between
+	 */
+	
+	NODE* splitLast(NODE* node, NODE*& last) const
+	{
+		NODE* right = rightChild(node);
+		if(right == nullptr)
+		{
+			last = node;
+			return node->Left;
+		}
+		
+		NODE* rest = splitLast(right, last);
+		return joinNodes(node->Left, node, rest);
+	}
+	
+	NODE* joinPair(NODE* left, NODE* right) const
+	{
+		if(left == nullptr)
+			return right;
+		if(right == nullptr)
+			return left;
+		
+		NODE* last;
+		NODE* rest = splitLast(left, last);
+		return joinThreaded(rest, last, right);
+	}
+	
+	/* DropList
+	 * 
+	 * nodes a set operation takes out of the tree, linked through Left.
+	 * They are destroyed once the operation is over, rather than while
+	 * several threads may be at work.
+	 */
+	
+	struct DropList
+	{
+		NODE*  Head = nullptr;
+		NODE*  Tail = nullptr;
+		size_t Count = 0;
+		
+		void push(NODE* node)
+		{
+			node->Left = Head;
+			Head = node;
+			if(Tail == nullptr)
+				Tail = node;
+			Count++;
+		}
+		
+		void pushSubtree(NODE* node)
+		{
+			if(node == nullptr)
+				return;
+			
+			NODE* right = rightChild(node);
+			pushSubtree(node->Left);
+			pushSubtree(right);
+			push(node);
+		}
+		
+		void append(DropList& other)
+		{
+			if(other.Head == nullptr)
+				return;
+			
+			other.Tail->Left = Head;
+			Head = other.Head;
+			if(Tail == nullptr)
+				Tail = other.Tail;
+			Count += other.Count;
+		}
+	};
+	
+	// set operations only hand subtrees this tall to another thread
+	static const int ForkHeight = 10;
+	
+	enum SetOp { Union, Intersection, Difference };
+	
+	/* combineNodes()
+	 * 
+	 * the join-based set operations. Combines the detached subtree under
+	 * node with the subtree under other, per op: the union, the keys of
+	 * node's subtree that are (Intersection) or are not (Difference) in
+	 * other's. node's subtree is split around other's root, the two sides
+	 * are combined with other's children, and the results joined back up.
+	 * Nodes that aren't kept go on dropped.
+	 * 
+	 * For Union, other's subtree must be a detached copy; its nodes are
+	 * linked in, and the copy of a key node's subtree already has is
+	 * dropped. Otherwise other's subtree is only read.
+	 * 
+	 * With threads > 1 the two sides are combined at the same time, the
+	 * left one on a new thread, with the threads divided between them.
+	 * Nothing is allocated or freed along the way, so the workers don't
+	 * share anything they change.
+	 */
+	
+	NODE* combineNodes(NODE* node, NODE* other, SetOp op, DropList& dropped, unsigned threads) const
+	{
+		if(node == nullptr)
+			return (op == Union) ? other : nullptr;
+		
+		if(other == nullptr)
+		{
+			if(op == Intersection)
+			{
+				dropped.pushSubtree(node);
+				return nullptr;
+			}
+			return node;
+		}
+		
+		NODE* otherLeft = other->Left;
+		NODE* otherRight = rightChild(other);
+		
+		NODE* lower;
+		NODE* found;
+		NODE* upper;
+		splitNodes(node, other->Key, lower, found, upper);
+		
+		NODE* left;
+		NODE* right;
+		
+		if(threads > 1 && subtreeHeight(other) >= ForkHeight)
+		{
+			DropList leftDropped;
+			unsigned leftThreads = threads / 2;
+			
+			std::thread worker([&]() {
+				left = combineNodes(lower, otherLeft, op, leftDropped, leftThreads);
+			});
+			right = combineNodes(upper, otherRight, op, dropped, threads - leftThreads);
+			worker.join();
+			
+			dropped.append(leftDropped);
+		}
+		else
+		{
+			left = combineNodes(lower, otherLeft, op, dropped, 1);
+			right = combineNodes(upper, otherRight, op, dropped, 1);
+		}
+		
+		if(op == Union)
+		{
+			if(found != nullptr)  // this tree's node and value win, like insert()
+				dropped.push(other);
+			else
+				found = other;
+			return joinThreaded(left, found, right);
+		}
+		
+		if(found != nullptr && op == Intersection)
+			return joinThreaded(left, found, right);
+		
+		if(found != nullptr)  // Difference
+			dropped.push(found);
+		return joinPair(left, right);
+	}
+	
+	/* combineWith()
+	 * 
+	 * runs combineNodes() on the whole tree and then tidies up: the last
+	 * node's thread is cleared, dropped nodes are destroyed, and Size is
+	 * set from what was added and dropped. A begin()/next() scan in
+	 * progress starts over.
+	 */
+	
+	void combineWith(NODE* other, int otherSize, SetOp op, unsigned threads)
+	{
+		DropList dropped;
+		
+		Root = combineNodes(ogRoot, other, op, dropped, (threads == 0) ? 1 : threads);
+		ogRoot = Root;
+		clearLastThread(Root);
+		
+		Size = Size + ((op == Union) ? otherSize : 0) - (int) dropped.Count;
+		destroyDropped(dropped);
+		
+		Cursor = nullptr;
+		hasBegun = false;
+	}
+	
+	/* clearLastThread()
+	 * 
+	 * makes a detached subtree a whole tree again: its last node loses
+	 * whatever thread it still has, since nothing comes after it
+	 */
+	
+	static void clearLastThread(NODE* root)
+	{
+		if(root == nullptr)
+			return;
+		
+		NODE* last = root;
+		while(rightChild(last) != nullptr)
+			last = rightChild(last);
+		last->Right = nullptr;
+		last->isThreaded = false;
+	}
+	
+	/* destroyDropped() / destroySubtree()
+	 * 
+	 * destroy the nodes a set or range operation took out; their storage
+	 * goes onto the pool's free list for the next inserts
+	 */
+	
+	void destroyDropped(DropList& dropped)
+	{
+		for(NODE* node = dropped.Head; node != nullptr; )
+		{
+			NODE* next = node->Left;
+			destroyNode(node);
+			node = next;
+		}
+		dropped = DropList();
+	}
+	
+	void destroySubtree(NODE* root)
+	{
+		DropList dropped;
+		dropped.pushSubtree(root);
+		destroyDropped(dropped);
+	}
+	
+	/* relocateTree()
+	 * 
+	 * same as cloneTree(), but moves each key and value out of the
+	 * original into a node of this tree's pool; the originals are left
+	 * to be destroyed by the tree they belong to
+	 */
+	
+	NODE* relocateTree(NODE* orig, NODE* after)
+	{
+		if(orig == nullptr)
+			return nullptr;
+		
+		NODE* node = emplaceNode(std::move(orig->Key), std::move(orig->Value));
+		node->Height = orig->Height;
+		copyCount(node, orig);
+		node->Left = relocateTree(orig->Left, node);
+		linkCloneRight(orig, node, after);
+		node->Right = (orig->isThreaded || orig->Right == nullptr) ? after : relocateTree(orig->Right, after);
+		return node;
+	}
+	
+	/* countSmaller()
+	 * 
+	 * walks the trees under a and b in order side by side until one runs
+	 * out, and returns how many nodes that one has, so it only takes as
+	 * long as the smaller tree is big. aSmaller says which one it was.
+	 */
+	
+	static int countSmaller(NODE* a, NODE* b, bool& aSmaller)
+	{
+		int count = 0;
+		NODE* x = leftmost(a);
+		NODE* y = leftmost(b);
+		
+		while(x != nullptr && y != nullptr)
+		{
+			count++;
+			x = successor(x);
+			y = successor(y);
+		}
+		
+		aSmaller = (x == nullptr);
+		return count;
+	}
+	
+	/* handOff()
+	 * 
+	 * helper function for split and extract_range, which have cut the
+	 * tree into two detached subtrees: this tree keeps "keep", and
+	 * "give" is returned as a tree of its own. Nodes can't change pools,
+	 * so the smaller of the two is moved into new nodes: if that's
+	 * "give", it goes to the new tree's pool; otherwise the new tree
+	 * takes over this tree's pool, nodes and all, and "keep" is moved
+	 * into a fresh pool here. The old nodes are destroyed onto the free
+	 * list of the pool they're in.
+	 */
+	
+	avlt handOff(NODE* keep, NODE* give)
+	{
+		clearLastThread(keep);
+		clearLastThread(give);
+		
+		bool giveSmaller;
+		int smaller = countSmaller(give, keep, giveSmaller);
+		int total = Size;
+		
+		avlt result(Less, Pool.get_allocator());
+		if(giveSmaller)
+		{
+			result.Root = result.relocateTree(give, nullptr);
+			result.Size = smaller;
+			destroySubtree(give);
+			
+			Root = keep;
+			Size = total - smaller;
+		}
+		else
+		{
+			result.Pool.swap(Pool);  // same allocator, so only the slabs change hands
+			result.Root = give;
+			result.Size = total - smaller;
+			
+			Root = relocateTree(keep, nullptr);
+			Size = smaller;
+			result.destroySubtree(keep);
+		}
+		
+		ogRoot = Root;
+		result.ogRoot = result.Root;
+		Cursor = nullptr;
+		hasBegun = false;
+		return result;
+	}
+
+	/* ScanPiece / ScanChunk
+	 *
+	 * how parallel_for_each and parallel_reduce divide up a range. A
+	 * piece is a whole subtree (Whole) or just the node Root, and Weight
+	 * is its # of nodes -- exact with AVLT_ORDER_STATISTICS, estimated
+	 * from the height without. The pieces of a range come in key order.
+	 * A chunk is a run of consecutive pieces, walked from First to Last
+	 * along the threads.
+	 */
+
+	struct ScanPiece
+	{
+		NODE*  Root;
+		bool   Whole;
+		size_t Weight;
+	};
+
+	struct ScanChunk
+	{
+		NODE* First;
+		NODE* Last;
+	};
+
+	static const size_t ScanGrain = 1024;  // smallest chunk worth a thread's time
+
+	static size_t subtreeWeight(const NODE* node)
+	{
+#ifdef AVLT_ORDER_STATISTICS
+		return subtreeCount(node);
+#else
+		return (node == nullptr) ? 0 : ((size_t) 1 << node->Height);
+#endif
+	}
+
+	static NODE* rightmost(NODE* node)
+	{
+		while(rightChild(node) != nullptr)
+			node = rightChild(node);
+		return node;
+	}
+
+	/* collectPieces()
+	 *
+	 * cuts the keys of the subtree at node that are in [*lower..*upper]
+	 * into pieces, where a null bound means no bound on that side. Once
+	 * both bounds are behind it, a subtree is one piece; on the way
+	 * there only the nodes in range are added, one at a time, so there
+	 * are O(lgN) pieces.
+	 */
+
+	void collectPieces(NODE* node, const KeyT* lower, const KeyT* upper, vector<ScanPiece>& pieces) const
+	{
+		while(node != nullptr)
+		{
+			if(lower == nullptr && upper == nullptr)
+			{
+				pieces.push_back(ScanPiece{ node, true, subtreeWeight(node) });
+				return;
+			}
+
+			if(lower != nullptr && Less(node->Key, *lower))
+				node = rightChild(node);
+			else if(upper != nullptr && Less(*upper, node->Key))
+				node = node->Left;
+			else
+			{
+				collectPieces(node->Left, lower, nullptr, pieces);  // all below node, so <= *upper
+				pieces.push_back(ScanPiece{ node, false, 1 });
+				node = rightChild(node);
+				lower = nullptr;
+			}
+		}
+	}
+
+	/* splitPiece()
+	 *
+	 * adds the subtree at node to pieces, broken up at its root (and so
+	 * on down) until no piece weighs more than target
+	 */
+
+	static void splitPiece(NODE* node, size_t target, vector<ScanPiece>& pieces)
+	{
+		while(node != nullptr)
+		{
+			size_t weight = subtreeWeight(node);
+			if(weight <= target)
+			{
+				pieces.push_back(ScanPiece{ node, true, weight });
+				return;
+			}
+
+			splitPiece(node->Left, target, pieces);
+			pieces.push_back(ScanPiece{ node, false, 1 });
+			node = rightChild(node);
+		}
+	}
+
+	/* scanChunks()
+	 *
+	 * divides the keys in [*lower..*upper] into about 4 chunks per
+	 * thread, of about the same weight, so that a thread that draws
+	 * light chunks picks up more of them. Nothing is compared or moved
+	 * below the O(lgN) nodes on the range's edges; the rest is cut at
+	 * subtree boundaries, using the heights (or subtree sizes) alone.
+	 */
+
+	vector<ScanChunk> scanChunks(const KeyT* lower, const KeyT* upper, unsigned threads) const
+	{
+		vector<ScanPiece> pieces;
+		collectPieces(ogRoot, lower, upper, pieces);
+
+		size_t total = 0;
+		for(size_t i = 0; i < pieces.size(); i++)
+			total += pieces[i].Weight;
+		size_t target = total / (4 * (size_t) threads);
+		if(target < ScanGrain)
+			target = ScanGrain;
+
+		vector<ScanPiece> split;
+		for(size_t i = 0; i < pieces.size(); i++)
+		{
+			if(pieces[i].Whole)
+				splitPiece(pieces[i].Root, target, split);
+			else
+				split.push_back(pieces[i]);
+		}
+
+		vector<ScanChunk> chunks;
+		size_t weight = 0;  // of the last chunk so far
+		for(size_t i = 0; i < split.size(); i++)
+		{
+			NODE* first = split[i].Whole ? leftmost(split[i].Root) : split[i].Root;
+			NODE* last = split[i].Whole ? rightmost(split[i].Root) : split[i].Root;
+			if(chunks.empty() || weight >= target)
+			{
+				chunks.push_back(ScanChunk{ first, last });
+				weight = 0;
+			}
+			else
+				chunks.back().Last = last;
+			weight += split[i].Weight;
+		}
+		return chunks;
+	}
+
+	/* runChunks()
+	 *
+	 * calls fn(i) for every i below count, on up to "threads" threads.
+	 * Rather than being dealt out up front, like runTasks() does, each
+	 * thread takes the next index left whenever it is done with one, so
+	 * the threads finish together even when the chunks' real sizes vary.
+	 */
+
+	template<typename Fn>
+	static void runChunks(size_t count, unsigned threads, Fn fn)
+	{
+		std::atomic<size_t> next(0);
+		auto work = [&next, count, &fn]() {
+			for(size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count; )
+				fn(i);
+		};
+
+		vector<std::thread> workers;
+		for(unsigned t = 1; t < threads && t < count; t++)
+			workers.push_back(std::thread(work));
+
+		work();
+
+		for(size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	/* parallelForEach() / parallelReduce()
+	 *
+	 * the work behind parallel_for_each and parallel_reduce; null bounds
+	 * mean the whole tree. parallelReduce() starts each chunk's result
+	 * from the chunk's first value before any thread starts, so T needs
+	 * no default constructor.
+	 */
+
+	template<typename Fn>
+	void parallelForEach(const KeyT* lower, const KeyT* upper, Fn& fn, unsigned threads) const
+	{
+		threads = max(threads, 1u);
+		vector<ScanChunk> chunks = scanChunks(lower, upper, threads);
+
+		runChunks(chunks.size(), threads, [&chunks, &fn, this](size_t i) {
+			for(NODE* node = chunks[i].First; ; node = nextRange(node))
+			{
+				fn((const KeyT&) node->Key, (const ValueT&) node->Value);
+				if(node == chunks[i].Last)
+					break;
+			}
+		});
+	}
+
+	template<typename T, typename Op>
+	T parallelReduce(const KeyT* lower, const KeyT* upper, T init, Op& op, unsigned threads) const
+	{
+		threads = max(threads, 1u);
+		vector<ScanChunk> chunks = scanChunks(lower, upper, threads);
+
+		vector<T> results;
+		results.reserve(chunks.size());
+		for(size_t i = 0; i < chunks.size(); i++)
+			results.push_back(T(chunks[i].First->Value));
+
+		runChunks(chunks.size(), threads, [&chunks, &results, &op, this](size_t i) {
+			for(NODE* node = chunks[i].First; node != chunks[i].Last; )
+			{
+				node = nextRange(node);
+				results[i] = op(std::move(results[i]), T(node->Value));
+			}
+		});
+
+		for(size_t i = 0; i < results.size(); i++)
+			init = op(std::move(init), std::move(results[i]));
+		return init;
+	}
+
+	/* unlinkNode()
+	 * 
+	 * erase() without the last step: takes the node with the given key
+	 * out of the tree and rebalances, but leaves the node itself alone
+	 * and returns it, or nullptr if the key isn't in the tree.
+	 * concurrent_avlt holds on to it until no reader can be looking at it.
+	 */
+	
+	NODE* unlinkNode(const KeyT& key)
+	{
+		NODE* path[MaxPath];  // ancestors of the node being removed
+		int depth = 0;
+		NODE* cur = ogRoot;
+		NODE* lower = nullptr;  // first node >= key so far, as in lowerNode()
+		int lowerDepth = 0;
+		
+		while(cur != nullptr)
+		{
+			if(!Less(cur->Key, key))
+			{
+				lower = cur;
+				lowerDepth = depth;
+				path[depth++] = cur;
+				cur = cur->Left;
+			}
+			else
+			{
+				path[depth++] = cur;
+				cur = cur->isThreaded ? nullptr : cur->Right;
+			}
+		}
+		statPath(depth);
+		
+		if(lower == nullptr || Less(key, lower->Key))  // not in tree
+			return nullptr;
+		
+		cur = lower;
+		depth = lowerDepth;  // only the nodes above it are its ancestors
+		
+		NODE* par = (depth > 0) ? path[depth - 1] : nullptr;
+		bool hasRight = !cur->isThreaded && cur->Right != nullptr;
+		NODE* replacement;
+		
+		if(cur->Left == nullptr)
+		{
+			// nothing threads to cur. if it's a leaf on the right of its
+			// parent, the parent now threads to where cur did
+			replacement = hasRight ? cur->Right : nullptr;
+			if(replacement == nullptr && par != nullptr && par->Right == cur)
+			{
+				par->Right = cur->Right;
+				par->isThreaded = cur->isThreaded;
+			}
+		}
+		else if(!hasRight)
+		{
+			// cur's predecessor is the largest node on its left, and it
+			// threads to cur; it now threads to where cur did
+			NODE* pred = cur->Left;
+			while(!pred->isThreaded)
+				pred = pred->Right;
+			
+			pred->Right = cur->Right;
+			pred->isThreaded = cur->isThreaded;
+			replacement = cur->Left;
+		}
+		else
+		{
+			// swap in cur's predecessor, which has no right child, and
+			// rebalance from where the predecessor came out
+			int curDepth = depth;
+			path[depth++] = cur;
+			
+			NODE* predPar = cur;
+			NODE* pred = cur->Left;
+			while(!pred->isThreaded)
+			{
+				path[depth++] = pred;
+				predPar = pred;
+				pred = pred->Right;
+			}
+			
+			if(predPar == cur)
+				cur->Left = pred->Left;
+			else if(pred->Left != nullptr)
+				predPar->Right = pred->Left;
+			else
+			{
+				predPar->Right = pred;  // predPar's successor is pred again
+				predPar->isThreaded = true;
+			}
+			
+			pred->Left = cur->Left;
+			pred->Right = cur->Right;
+			pred->isThreaded = false;
+			pred->Height = cur->Height;
+			copyCount(pred, cur);
+			path[curDepth] = pred;
+			replacement = pred;
+		}
+		
+		if(par == nullptr)
+		{
+			Root = replacement;
+			ogRoot = Root;
+		}
+		else if(par->Left == cur)
+			par->Left = replacement;
+		else if(par->Right == cur)
+			par->Right = replacement;
+		
+		if(Cursor == cur)  // keep a begin()/next() scan going past it
+			Cursor = successor(cur);
+		
+		Size--;
+		for(int i = 0; i < depth; i++)
+			addCount(path[i], -1);
+		
+		rebalanceUp(path, depth);
+		return cur;
+	}
+	
+	/* lowerNode() / upperNode() / findNode()
+	 * 
+	 * the descents behind every lookup. Each level makes one call to Less:
+	 * lowerNode() goes left whenever the node isn't below key, remembering
+	 * it, so the last node remembered is the first one >= key. findNode()
+	 * then checks once, at the bottom, whether that node is key itself,
+	 * rather than testing for equality on every level on the way down.
+	 * K is KeyT, or anything a transparent Compare takes.
+	 */
+	
+	template<typename K>
+	NODE* lowerNode(const K& key) const
+	{
+		NODE* cur = ogRoot;
+		NODE* found = nullptr;  // smallest node seen so far that is >= key
+		int length = 0;
+		while(cur != nullptr)
+		{
+			length++;
+			if(!Less(cur->Key, key))
+			{
+				found = cur;
+				cur = cur->Left;
+			}
+			else
+				cur = cur->isThreaded ? nullptr : cur->Right;
+		}
+		statLookup(length);
+		return found;
+	}
+	
+	template<typename K>
+	NODE* upperNode(const K& key) const
+	{
+		NODE* cur = ogRoot;
+		NODE* found = nullptr;  // smallest node seen so far that is > key
+		int length = 0;
+		while(cur != nullptr)
+		{
+			length++;
+			if(Less(key, cur->Key))
+			{
+				found = cur;
+				cur = cur->Left;
+			}
+			else
+				cur = cur->isThreaded ? nullptr : cur->Right;
+		}
+		statLookup(length);
+		return found;
+	}
+	
+	template<typename K>
+	NODE* findNode(const K& key) const
+	{
+		NODE* node = lowerNode(key);
+		if(node == nullptr)
+			return nullptr;
+		statComparison();
+		if(Less(key, node->Key))
+			return nullptr;
+		return node;
+	}
+	
+public:
+
+  class const_iterator;  // see below, next to cbegin() / cend()
+
+  //
+  // default constructor:
+  //
+  // Creates an empty tree.
+  //
+  avlt()
+    : Pool(Alloc()), Less()
+  {
+    Root = nullptr;
+    Size = 0;
+		ogRoot = nullptr;
+		Cursor = nullptr;
+		hasBegun = false;
+  }
+	
+  //
+  // allocator constructor:
+  //
+  // Creates an empty tree whose nodes come from the given allocator.
+  //
+  explicit avlt(const Alloc& alloc)
+    : Pool(alloc), Less()
+  {
+    Root = nullptr;
+    Size = 0;
+		ogRoot = nullptr;
+		Cursor = nullptr;
+		hasBegun = false;
+  }
+
+  //
+  // comparator constructor:
+  //
+  // Creates an empty tree ordered by the given comparator.
+  //
+  explicit avlt(const Compare& comp, const Alloc& alloc = Alloc())
+    : Pool(alloc), Less(comp)
+  {
+    Root = nullptr;
+    Size = 0;
+		ogRoot = nullptr;
+		Cursor = nullptr;
+		hasBegun = false;
+  }
 	
 
   //
@@ -470,88 +2618,413 @@ public:
   // NOTE: makes an exact copy of the "other" tree, such that making the
   // copy requires no rotations.
   //
+  // Time complexity:  O(N)
+  //
   avlt (const avlt& other)
+    : Pool(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.Pool.get_allocator())),
+      Less(other.Less)
   {
-    ogRoot = nullptr;
-		Root = nullptr;
-		insertCopy(other.Root);
+		Root = cloneTree(other.ogRoot, nullptr);
+		ogRoot = Root;
+		Size = other.Size;
+		Cursor = nullptr;
+		hasBegun = false;
+  }
+
+	//
+  // destructor:
+  //
+  // Called automatically by system when tree is about to be destroyed;
+  // this is our last chance to free any resources / memory used by
+  // this tree.
+  //
+  virtual ~avlt()
+  {
+    releaseAll();
+		Size = 0;
+  }
+
+  //
+  // operator=
+  //
+  // Clears "this" tree and then makes a copy of the "other" tree.
+  //
+  // NOTE: makes an exact copy of the "other" tree, such that making the
+  // copy requires no rotations.
+  //
+  // Time complexity:  O(N)
+  //
+  avlt& operator=(const avlt& other)
+  {
+    if(this == &other)
+      return *this;
+		
+    this->clear();
+		Less = other.Less;
+		Root = cloneTree(other.ogRoot, nullptr);
 		ogRoot = Root;
 		Size = other.Size;
+		Cursor = nullptr;
+		hasBegun = false;
+		return *this;
+  }
+
+  //
+  // move constructor
+  //
+  // Takes over the nodes of the "other" tree, leaving it empty. No nodes
+  // are copied or allocated.
+  //
+  // Time complexity:  O(1)
+  //
+  avlt(avlt&& other) noexcept
+    : Pool(std::move(other.Pool)), Less(std::move(other.Less))
+  {
+    Root = other.Root;
+    Size = other.Size;
+		ogRoot = other.ogRoot;
+		Cursor = other.Cursor;
+		hasBegun = other.hasBegun;
+		
+		other.Root = nullptr;
+		other.Size = 0;
+		other.ogRoot = nullptr;
+		other.Cursor = nullptr;
+		other.hasBegun = false;
+  }
+
+  //
+  // move operator=
+  //
+  // Clears "this" tree and then takes over the nodes of the "other" tree,
+  // leaving it empty. If the allocators differ and cannot be moved over,
+  // the nodes have to be copied instead.
+  //
+  // Time complexity:  O(1), O(N) with unequal allocators
+  //
+  avlt& operator=(avlt&& other)
+    noexcept(std::allocator_traits<Alloc>::propagate_on_container_move_assignment::value ||
+             std::allocator_traits<Alloc>::is_always_equal::value)
+  {
+    if(this == &other)
+      return *this;
+		
+		if(!std::allocator_traits<Alloc>::propagate_on_container_move_assignment::value &&
+		   !(get_allocator() == other.get_allocator()))
+		{
+			*this = other;  // can't take nodes that belong to another allocator
+			other.clear();
+			return *this;
+		}
+		
+		// the allocator moves over before the slabs, so they are always
+		// given back to the allocator that handed them out
+		this->clear();
+		Pool = std::move(other.Pool);
+		Less = std::move(other.Less);
+		Root = other.Root;
+		Size = other.Size;
+		ogRoot = other.ogRoot;
+		Cursor = other.Cursor;
 		hasBegun = other.hasBegun;
+		
+		other.Root = nullptr;
+		other.Size = 0;
+		other.ogRoot = nullptr;
+		other.Cursor = nullptr;
+		other.hasBegun = false;
+		return *this;
+  }
+
+  //
+  // swap
+  //
+  // Exchanges the contents of "this" tree and the "other" tree.
+  //
+  // Time complexity:  O(1)
+  //
+  void swap(avlt& other) noexcept
+  {
+    using std::swap;
+		Pool.swap(other.Pool);
+		swap(Less, other.Less);
+		swap(Root, other.Root);
+		swap(Size, other.Size);
+		swap(ogRoot, other.ogRoot);
+		swap(Cursor, other.Cursor);
+		swap(hasBegun, other.hasBegun);
+  }
+
+  friend void swap(avlt& a, avlt& b) noexcept
+  {
+    a.swap(b);
+  }
+
+  //
+  // range constructor
+  //
+  // Creates a tree holding the (key, value) pairs in [first, last); see
+  // bulk_load().
+  //
+  template<typename It>
+  avlt(It first, It last, const Alloc& alloc = Alloc())
+    : Pool(alloc), Less()
+  {
+    Root = nullptr;
+    Size = 0;
+		ogRoot = nullptr;
+		Cursor = nullptr;
+		hasBegun = false;
+		bulk_load(first, last);
+  }
+
+  template<typename It>
+  avlt(It first, It last, const Compare& comp, const Alloc& alloc = Alloc())
+    : Pool(alloc), Less(comp)
+  {
+    Root = nullptr;
+    Size = 0;
+		ogRoot = nullptr;
+		Cursor = nullptr;
+		hasBegun = false;
+		bulk_load(first, last);
+  }
+
+  //
+  // bulk_load
+  //
+  // Replaces the contents of the tree with the (key, value) pairs in
+  // [first, last), which should be sorted by key. The tree is built
+  // perfectly balanced in one pass, with no searching or rotations. If a
+  // key repeats, its first value is kept, like insert(). If the keys turn
+  // out not to be sorted, they are simply inserted one at a time.
+  //
+  // Time complexity:  O(N) for sorted input, O(NlgN) otherwise
+  //
+  template<typename It>
+  void bulk_load(It first, It last)
+  {
+    static_assert(std::is_base_of<std::forward_iterator_tag,
+                    typename std::iterator_traits<It>::iterator_category>::value,
+                  "bulk_load needs forward iterators");
+		
+    this->clear();
+		
+		size_t count;
+		if(!countSorted(first, last, count))
+		{
+			for(; first != last; ++first)
+				insert(first->first, first->second);
+			return;
+		}
+		
+		NODE* pending = nullptr;
+		Root = buildBalanced(first, last, count, pending);
+		ogRoot = Root;
+		Size = (int) count;
+  }
+
+  //
+  // copy_from
+  //
+  // Clears "this" tree and then makes an exact copy of the "other" tree,
+  // splitting the work by subtree across the given # of threads. Falls
+  // back to a single thread when copying a key or value could throw.
+  //
+  // Time complexity:  O(N / threads)
+  //
+  void copy_from(const avlt& other, unsigned threads)
+  {
+    if(this == &other)
+      return;
+		
+    this->clear();
+		Less = other.Less;
+		
+		if(threads > 1 && other.Size > 1 &&
+		   std::is_nothrow_copy_constructible<KeyT>::value &&
+		   std::is_nothrow_copy_constructible<ValueT>::value)
+			Root = cloneParallel(other.ogRoot, threads);
+		else
+			Root = cloneTree(other.ogRoot, nullptr);
+		
+		ogRoot = Root;
+		Size = other.Size;
+		Cursor = nullptr;
+		hasBegun = false;
+  }
+
+  //
+  // clear:
+  //
+  // Clears the contents of the tree, resetting the tree to empty.
+  //
+  void clear()
+  {
+    // calls releaseAll and then resetting Root and ogRoot to nullptr
+		releaseAll();
+		Root = nullptr;
+		ogRoot = nullptr;
+		Size = 0;
+		Cursor = nullptr;
+		hasBegun = false;
+  }
+
+  // 
+  // size:
+  //
+  // Returns the # of nodes in the tree, 0 if empty.
+  //
+  // Time complexity:  O(1) 
+  //
+  int size() const
+  {
+    return Size;
+  }
+
+  // 
+  // height:
+  //
+  // Returns the height of the tree, -1 if empty.
+  //
+  // Time complexity:  O(1) 
+  //
+  int height() const
+  {
+    if (Root == nullptr)
+      return -1;
+    else
+      return Root->Height;
+  }
+
+#ifdef AVLT_STATS
+  //
+  // stats
+  //
+  // Returns what this tree's operations have cost since it was created
+  // or reset_stats() was last called: rotations, comparisons per lookup,
+  // how far inserts rebalanced, path lengths and node allocations (see
+  // avlt_stats above). Copies and moved-to trees keep their own counts.
+  //
+  // Time complexity:  O(1)
+  //
+  avlt_stats stats() const
+  {
+    avlt_stats result;
+    result.Rotations = Stats.Rotations.load(std::memory_order_relaxed);
+    result.Inserts = Stats.Inserts.load(std::memory_order_relaxed);
+    result.Searches = Stats.Searches.load(std::memory_order_relaxed);
+    result.SearchComparisons = Stats.SearchComparisons.load(std::memory_order_relaxed);
+    result.NodeAllocations = Stats.NodeAllocations.load(std::memory_order_relaxed);
+    result.NodeFrees = Stats.NodeFrees.load(std::memory_order_relaxed);
+    for(int i = 0; i < avlt_stats::Buckets; i++)
+    {
+      result.RebalanceDepths[i] = Stats.RebalanceDepths[i].load(std::memory_order_relaxed);
+      result.PathLengths[i] = Stats.PathLengths[i].load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  //
+  // reset_stats
+  //
+  // Sets every count stats() returns back to zero.
+  //
+  // Time complexity:  O(1)
+  //
+  void reset_stats()
+  {
+    Stats.reset();
+  }
+#endif
+
+  //
+  // freeze:
+  //
+  // Returns a read-only copy of the tree's contents in a flat layout made
+  // for searching (see frozen_avlt.h), with the same search, operator[]
+  // and range_search. Later changes to the tree don't show up in it.
+  //
+  // Time complexity:  O(N)
+  //
+  frozen_avlt<KeyT, ValueT, Compare> freeze() const
+  {
+    vector<KeyT> keys;
+    vector<ValueT> values;
+    keys.reserve(Size);
+    values.reserve(Size);
+
+		for(NODE* cur = leftmost(ogRoot); cur != nullptr; cur = successor(cur))
+		{
+			keys.push_back(cur->Key);
+			values.push_back(cur->Value);
+		}
+
+    return frozen_avlt<KeyT, ValueT, Compare>(std::move(keys), std::move(values), Less);
   }
 
-	//
-  // destructor:
   //
-  // Called automatically by system when tree is about to be destroyed;
-  // this is our last chance to free any resources / memory used by
-  // this tree.
+  // save
   //
-  virtual ~avlt()
+  // Writes the tree to the file at path in a binary snapshot format,
+  // nodes as records linked by index, that load() maps straight back
+  // into memory. Only for trivially copyable KeyT and ValueT; see
+  // mapped_avlt.h for the format. Returns false if the file couldn't be
+  // written. save() and load() are built on mapped_avlt, which uses
+  // POSIX mmap, so a program that calls them includes mapped_avlt.h.
+  //
+  // Time complexity:  O(N)
+  //
+  bool save(const string& path) const
   {
-		Root = ogRoot;
-    clearTree(ogRoot);
-		Size = 0;
+    return mapped_avlt<KeyT, ValueT, Compare>::save(*this, path);
   }
 
   //
-  // operator=
+  // load
   //
-  // Clears "this" tree and then makes a copy of the "other" tree.
+  // Maps a file written by save() and returns it as a read-only tree,
+  // searched where it lies rather than inserted again. is_open() on the
+  // result is false if the file couldn't be used. Call materialize() on
+  // it for a mutable avlt with the same contents. Needs mapped_avlt.h.
   //
-  // NOTE: makes an exact copy of the "other" tree, such that making the
-  // copy requires no rotations.
+  // Time complexity:  O(N), to check the file
   //
-  avlt& operator=(const avlt& other)
+  static mapped_avlt<KeyT, ValueT, Compare> load(const string& path, const Compare& comp = Compare())
   {
-    this->clear();
-		Root = nullptr;
-		insertCopy(other.Root);
-		ogRoot = Root;
-		Size = other.Size;
-		hasBegun = other.hasBegun;
-		return *this;
+    return mapped_avlt<KeyT, ValueT, Compare>(path, comp);
   }
 
   //
-  // clear:
+  // memory_usage:
   //
-  // Clears the contents of the tree, resetting the tree to empty.
+  // Returns the bytes the tree holds: the object itself plus every slab
+  // in its pool, including nodes on the free list and not yet used.
+  // sizeof the node is the cost per entry.
   //
-  void clear()
+  size_t memory_usage() const
   {
-    // calls clearTree and then resetting Root and ogRoot to nullptr
-		clearTree(ogRoot);
-		Root = nullptr;
-		ogRoot = nullptr;
-		Size = 0;
+    return sizeof(*this) + Pool.capacity_bytes();
   }
 
-  // 
-  // size:
   //
-  // Returns the # of nodes in the tree, 0 if empty.
+  // get_allocator:
   //
-  // Time complexity:  O(1) 
+  // Returns a copy of the allocator the tree's nodes come from.
   //
-  int size() const
+  Alloc get_allocator() const
   {
-    return Size;
+    return Pool.get_allocator();
   }
 
-  // 
-  // height:
   //
-  // Returns the height of the tree, -1 if empty.
+  // key_comp:
   //
-  // Time complexity:  O(1) 
+  // Returns a copy of the comparator that orders the keys.
   //
-  int height() const
+  Compare key_comp() const
   {
-    if (Root == nullptr)
-      return -1;
-    else
-      return Root->Height;
+    return Less;
   }
 	
 	
@@ -564,46 +3037,159 @@ public:
   // and false if not.  If the key is found, the corresponding value
   // is returned via the reference parameter.
   //
+  // The descent makes one comparison per level and only checks for an
+  // exact match once it reaches the bottom (see findNode()).
+  //
   // Time complexity:  O(lgN) worst-case
   //
-  bool search(KeyT key, ValueT& value) const
+  bool search(const KeyT& key, ValueT& value) const
 	{
-     //
-     // TODO:
-     //
-		NODE* cur = Root;
+		NODE* cur = findNode(key);
 		if(cur == nullptr)
-		{
 			return false;
-		}
 		
+		value = cur->Value;
+		return true;
+	}
+
+  // with a transparent Compare, key can be anything Compare takes
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool search(const K& key, ValueT& value) const
+	{
+		NODE* cur = findNode(key);
+		if(cur == nullptr)
+			return false;
+		
+		value = cur->Value;
+		return true;
+	}
+
+  //
+  // search_many
+  //
+  // Searches the tree for every key in "keys". values[i] and found[i] are
+  // set the same way search() would for keys[i]; keys that aren't found
+  // get the default value ValueT{}. Returns the # of keys found.
+  //
+  // Instead of one descent after another, a group of descents advances
+  // one level at a time in lockstep, prefetching each next node, so the
+  // cache misses of the whole group overlap instead of adding up.
+  //
+  // Time complexity:  O(KlgN), K = # of keys
+  //
+  size_t search_many(const vector<KeyT>& keys, vector<ValueT>& values, vector<bool>& found) const
+  {
+    values.assign(keys.size(), ValueT{});
+    found.assign(keys.size(), false);
+		
+		size_t count = 0;
 		
-		while(cur != nullptr) // while cur is still a node
+		for(size_t base = 0; base < keys.size(); base += SearchGroup)
 		{
-			if(key == cur->Key) // checks if the key is found
+			size_t n = min(SearchGroup, keys.size() - base);
+			const NODE* cur[SearchGroup];
+			const NODE* lower[SearchGroup];  // first node >= the key so far, as in lowerNode()
+			int length[SearchGroup];         // for stats()
+			
+			for(size_t j = 0; j < n; j++)
 			{
-				value = cur->Value;
-				return true;     // returns true if so and updates value
-			} 
-			else if(key < cur->Key)
+				cur[j] = ogRoot;
+				lower[j] = nullptr;
+				length[j] = 0;
+			}
+			
+			size_t active = (ogRoot != nullptr) ? n : 0;
+			while(active > 0)
 			{
-				cur = cur->Left;    // if cur->Key is bigger, it moves left (to a smaller)
-			}                     // value and then runs the loop again
-			else 
+				active = 0;
+				for(size_t j = 0; j < n; j++)
+				{
+					const NODE* node = cur[j];
+					if(node == nullptr)  // this descent is done
+						continue;
+					
+					const KeyT& key = keys[base + j];
+					length[j]++;
+					if(!Less(node->Key, key))
+					{
+						lower[j] = node;
+						node = node->Left;
+					}
+					else
+						node = node->isThreaded ? nullptr : node->Right;
+					
+					cur[j] = node;
+					if(node != nullptr)
+					{
+						AVLT_PREFETCH(node);
+						active++;
+					}
+				}
+			}
+			
+			for(size_t j = 0; j < n; j++)
 			{
-				if(cur->isThreaded){ 
-					return false;    // if the node is threaded but the key its trying to find is bigger
-				}                  // it returns false because we dont need to go back up the tree. 
-				else  
+				statLookup(length[j]);
+				if(lower[j] != nullptr)
+					statComparison();
+				
+				if(lower[j] != nullptr && !Less(keys[base + j], lower[j]->Key))
 				{
-					if(key > cur->Key)  // if its not threaded and the key is bigger than the node's key
-						cur = cur->Right; // it moves right to a node with a greater value
+					values[base + j] = lower[j]->Value;
+					found[base + j] = true;
+					count++;
 				}
 			}
 		}
+		
+		return count;
+  }
 
-		return false; // if it breaks out of the loop it didn't find it and cur == nullptr
-	}
+  //
+  // range_bounds
+  //
+  // Which ends of a range are part of it, for range_for_each and the
+  // output-iterator range_search: closed is [lower..upper], half_open is
+  // [lower..upper), left_open is (lower..upper] and open is (lower..upper).
+  //
+  enum range_bounds { closed, half_open, left_open, open };
+
+  //
+  // range_for_each
+  //
+  // Calls fn(key, value) on every key in the range from lower to upper,
+  // in order, where bounds says whether lower and upper themselves count.
+  // The key and value are passed by const reference straight out of the
+  // nodes, so nothing is copied or allocated. If fn returns bool, returning
+  // false stops the scan early. Returns the # of keys fn was called on.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys visited
+  //
+  template<typename Fn>
+  size_t range_for_each(const KeyT& lower, const KeyT& upper, Fn fn, range_bounds bounds = closed) const
+  {
+    size_t visited = 0;
+
+		NODE* current = findLower(lower);
+		if(current != nullptr && (bounds == left_open || bounds == open) && !Less(lower, current->Key))
+			current = nextRange(current);
+
+		bool upperOpen = (bounds == half_open || bounds == open);
+		while(current != nullptr && (upperOpen ? Less(current->Key, upper) : !Less(upper, current->Key)))
+		{
+			visited++;
+			if constexpr(std::is_same<decltype(fn(current->Key, current->Value)), bool>::value)
+			{
+				if(!fn((const KeyT&) current->Key, (const ValueT&) current->Value))
+					break;
+			}
+			else
+				fn((const KeyT&) current->Key, (const ValueT&) current->Value);
+
+			current = nextRange(current);
+		}
+		return visited;
+  }
 
   //
   // range_search
@@ -620,192 +3206,472 @@ public:
   // Be smarter, you have the technology.
   //
 
-	vector<KeyT> range_search(KeyT lower, KeyT upper){
-		//first go to most left node
+	vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const {
 		vector<KeyT> keys;
-		
-		if(Root == nullptr)
-			return keys;
+		range_search(lower, upper, back_inserter(keys));
+		return keys;
+	}
 
-		NODE* current = nullptr;
-		current = findLower(lower);
-		
-		if(current == nullptr){
-			return keys;
-		}
+  //
+  // range_search (output iterator)
+  //
+  // Writes the keys in the range to out, in order, instead of building a
+  // vector, and returns out advanced past the last one. bounds is as for
+  // range_for_each.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  template<typename OutputIt>
+  OutputIt range_search(const KeyT& lower, const KeyT& upper, OutputIt out, range_bounds bounds = closed) const
+  {
+    range_for_each(lower, upper, [&out](const KeyT& key, const ValueT&) { *out++ = key; }, bounds);
+    return out;
+  }
 
-		if(current->Key < lower){
-			return keys;
-		}
+  //
+  // parallel_for_each
+  //
+  // Calls fn(key, value) on every key in [lower..upper], inclusive, or
+  // in the whole tree without a range, using the given # of threads (by
+  // default one per hardware thread). The range is cut at subtree
+  // boundaries into chunks of about the same size, and each thread walks
+  // one chunk after another, in order, until none are left. So fn is
+  // called from several threads at once, and the keys are only in order
+  // within a chunk. fn must not throw, and the tree must not change
+  // until the call returns.
+  //
+  // Time complexity: O(lgN + M / threads), where M is the # of keys visited
+  //
+  template<typename Fn>
+  void parallel_for_each(const KeyT& lower, const KeyT& upper, Fn fn,
+                         unsigned threads = std::thread::hardware_concurrency()) const
+  {
+    if(!Less(upper, lower))
+      parallelForEach(&lower, &upper, fn, threads);
+  }
+
+  template<typename Fn>
+  void parallel_for_each(Fn fn, unsigned threads = std::thread::hardware_concurrency()) const
+  {
+    parallelForEach(nullptr, nullptr, fn, threads);
+  }
+
+  //
+  // parallel_reduce
+  //
+  // Folds the values of the keys in [lower..upper], or of the whole
+  // tree, into init with op(T, T), split over threads like
+  // parallel_for_each. Each chunk is folded on its own, and the chunks'
+  // results are then folded into init in key order, so op must be
+  // associative but needn't be commutative: the result is that of
+  // folding the values left to right. T must be constructible from a
+  // ValueT, and op must not throw. Returns init for an empty range.
+  //
+  // Time complexity: O(lgN + M / threads), where M is the # of keys visited
+  //
+  template<typename T, typename Op>
+  T parallel_reduce(const KeyT& lower, const KeyT& upper, T init, Op op,
+                    unsigned threads = std::thread::hardware_concurrency()) const
+  {
+    if(Less(upper, lower))
+      return init;
+    return parallelReduce(&lower, &upper, std::move(init), op, threads);
+  }
+
+  template<typename T, typename Op>
+  T parallel_reduce(T init, Op op, unsigned threads = std::thread::hardware_concurrency()) const
+  {
+    return parallelReduce(nullptr, nullptr, std::move(init), op, threads);
+  }
+
+
+	NODE* findLower(const KeyT& key) const {
+		return lowerNode(key);  // first node >= key, nullptr if none
+	}
+
+	
+
+  //
+  // insert
+  //
+  // Inserts the given key into the tree; if the key has already been insert then
+  // the function returns without changing the tree.  Rotations are performed
+  // as necessary to keep the tree balanced according to AVL definition.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+	
+	void insert(const KeyT& key, const ValueT& value)
+	{
+		insertNode(key, [&]() { return createNode(key, value); });
+	}
+
+  //
+  // try_emplace
+  //
+  // Inserts key with a value constructed in place from args, unless key
+  // is already in the tree, in which case nothing is built and the tree
+  // is left alone, like insert(). Returns an iterator to key's node and
+  // whether it was inserted. A key passed as an rvalue is moved into the
+  // node.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  template<typename... Args>
+  pair<const_iterator, bool> try_emplace(const KeyT& key, Args&&... args)
+  {
+    pair<NODE*, bool> result = insertNode(key, [&]() {
+      return emplaceNode(key, std::forward<Args>(args)...);
+    });
+    return make_pair(const_iterator(result.first), result.second);
+  }
+
+  template<typename... Args>
+  pair<const_iterator, bool> try_emplace(KeyT&& key, Args&&... args)
+  {
+    pair<NODE*, bool> result = insertNode(key, [&]() {
+      return emplaceNode(std::move(key), std::forward<Args>(args)...);
+    });
+    return make_pair(const_iterator(result.first), result.second);
+  }
+
+  //
+  // insert_or_assign
+  //
+  // Inserts key with the given value, or, if key is already in the tree,
+  // assigns the value to it (moving it in if it's an rvalue). Returns an
+  // iterator to key's node and whether it was inserted.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  template<typename M>
+  pair<const_iterator, bool> insert_or_assign(const KeyT& key, M&& value)
+  {
+    pair<NODE*, bool> result = insertNode(key, [&]() {
+      return emplaceNode(key, std::forward<M>(value));
+    });
+    if(!result.second)
+      result.first->Value = std::forward<M>(value);
+    return make_pair(const_iterator(result.first), result.second);
+  }
+
+  template<typename M>
+  pair<const_iterator, bool> insert_or_assign(KeyT&& key, M&& value)
+  {
+    pair<NODE*, bool> result = insertNode(key, [&]() {
+      return emplaceNode(std::move(key), std::forward<M>(value));
+    });
+    if(!result.second)
+      result.first->Value = std::forward<M>(value);
+    return make_pair(const_iterator(result.first), result.second);
+  }
+
+  //
+  // find_value
+  //
+  // Returns a pointer to the value stored with key, through which it can
+  // be read or changed in place, or nullptr if key is not in the tree.
+  // The pointer stays valid until key is erased.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT* find_value(const KeyT& key)
+  {
+    NODE* cur = findNode(key);
+    return (cur == nullptr) ? nullptr : &cur->Value;
+  }
+
+  const ValueT* find_value(const KeyT& key) const
+  {
+    NODE* cur = findNode(key);
+    return (cur == nullptr) ? nullptr : &cur->Value;
+  }
+
+  // with a transparent Compare, key can be anything Compare takes
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  ValueT* find_value(const K& key)
+  {
+    NODE* cur = findNode(key);
+    return (cur == nullptr) ? nullptr : &cur->Value;
+  }
+
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  const ValueT* find_value(const K& key) const
+  {
+    NODE* cur = findNode(key);
+    return (cur == nullptr) ? nullptr : &cur->Value;
+  }
+
+  //
+  // erase
+  //
+  // Removes the given key from the tree, returning true if it was found
+  // and false if not. Rotations are performed as necessary to keep the
+  // tree balanced according to AVL definition, and the thread that
+  // pointed at the removed node is moved to its successor. The node goes
+  // back to the pool for the next insert to reuse.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool erase(const KeyT& key)
+  {
+    NODE* node = unlinkNode(key);
+    if(node == nullptr)
+      return false;
+
+		destroyNode(node);
+		return true;
+  }
+
+  //
+  // insert_batch
+  //
+  // Inserts every (key, value) pair of the batch, same as calling insert()
+  // on each in turn: keys already in the tree are left alone, and if the
+  // batch repeats a key its first value wins. The batch is sorted in
+  // place (move it in if it's not needed afterwards). Sorted keys are then
+  // inserted picking up each descent where the previous one left off,
+  // or, when the batch is large next to the tree, merged with the tree's
+  // nodes and the whole tree relinked balanced in one pass.
+  //
+  // Time complexity:  O(MlgM + Mlg(N/M + 1)) for small batches,
+  //                   O(MlgM + N) for large ones
+  //
+  void insert_batch(vector<pair<KeyT, ValueT>> batch)
+  {
+    if(batch.empty())
+      return;
 		
-		//now travel using right pointers
-		while(current != nullptr && current->Key <= upper){
-			keys.push_back(current->Key);
+		std::stable_sort(batch.begin(), batch.end(),
+		  [this](const pair<KeyT, ValueT>& a, const pair<KeyT, ValueT>& b) {
+		    return Less(a.first, b.first);
+		  });
 		
-			current = nextRange(current);
+		if(batch.size() * RebuildRatio >= (size_t) Size)
+		{
+			rebuildMerged(batch);
+			return;
 		}
 		
-		return keys;
-	}
+		PathStep path[MaxPath];
+		int depth = 0;
+		for(size_t i = 0; i < batch.size(); i++)
+			insertFromPath(path, depth, batch[i].first, batch[i].second);
+  }
 
+  //
+  // merge / intersect / difference
+  //
+  // Set operations with another tree of the same type, done in place:
+  // merge adds every key of other that isn't in this tree yet, with its
+  // value (keys in both keep this tree's value, like insert()),
+  // intersect removes every key that isn't in other, and difference
+  // removes every key that is. other is left as it is.
+  //
+  // They split this tree around other's keys and join the pieces back
+  // together, rather than searching key by key, so the work grows with
+  // the smaller tree: O(M lg(N/M + 1)) for trees of M <= N keys. merge
+  // also copies other's nodes first, which is O(size of other), and the
+  // nodes removed cost O(1) each. Heights and threads are kept right
+  // throughout, the tree is never rebuilt.
+  //
+  // With threads > 1, the independent halves of the work run on up to
+  // that many threads at once (and merge copies other's nodes with
+  // copy_from's parallel copy, where copying can't throw).
+  //
+  void merge(const avlt& other, unsigned threads = 1)
+  {
+    if(this == &other || other.Size == 0)
+      return;
+		
+		NODE* copy;
+		if(threads > 1 && other.Size > 1 &&
+		   std::is_nothrow_copy_constructible<KeyT>::value &&
+		   std::is_nothrow_copy_constructible<ValueT>::value)
+			copy = cloneParallel(other.ogRoot, threads);
+		else
+			copy = cloneTree(other.ogRoot, nullptr);
+		
+		combineWith(copy, other.Size, Union, threads);
+  }
 
-	NODE* findLower(KeyT key){
-		if(Root == nullptr){
-			return Root;
-		}
+  void intersect(const avlt& other, unsigned threads = 1)
+  {
+    if(this == &other)
+      return;
 		
-		NODE* cur = ogRoot;
+		combineWith(other.ogRoot, 0, Intersection, threads);
+  }
+
+  void difference(const avlt& other, unsigned threads = 1)
+  {
+    if(this == &other)
+    {
+      this->clear();
+      return;
+    }
 		
-		while(cur != nullptr) // while cur is still a node
-		{
-			//cout << "CUR KEY IS: " << cur->Key << endl;
-			if(key == cur->Key) // checks if the key is found
-			{
-				return cur;     // returns true if so and updates value
-			}
-			else if(key < cur->Key)
-			{
-				if(cur->Left != nullptr){
-					//cout << "SUPPOSED TO GO TO: "<< cur->Left->Key << endl;
-					if(cur->Left->Key >= key || !cur->Left->isThreaded){
-						cur = cur->Left;
-						}
-					else
-						return cur;
-				}
-				else {
-					return cur;						
-				}
-			}                     
-			else 
-			{
-				if(cur->isThreaded){ 
-					if(cur->Right->Key >= key)
-						return cur->Right;
-					else
-						return nullptr;
-				}                  
-				else  
-				{
-						if(cur->Right != nullptr){
-							cur = cur->Right;
-						}
-						else{
-							return nullptr;
-						}
-				}
-			}
-		}
-		return nullptr;
-	}
+		combineWith(other.ogRoot, 0, Difference, threads);
+  }
 
-	
+  //
+  // split
+  //
+  // Cuts the tree at key: this tree keeps the keys below key, and the
+  // keys from key on are returned as a new tree. The cut is an AVL split,
+  // O(lgN), with the threads across it fixed up; then the smaller half is
+  // moved into nodes of its new tree's pool (the larger half keeps its
+  // nodes, and takes the pool along if it's the one returned).
+  //
+  // Time complexity:  O(lgN + K), K the # of keys in the smaller half
+  //
+  avlt split(const KeyT& key)
+  {
+    NODE* lower;
+    NODE* found;
+    NODE* upper;
+		
+		splitNodes(ogRoot, key, lower, found, upper);
+		if(found != nullptr)
+			upper = joinNodes(nullptr, found, upper);  // key itself goes with the upper half
+		
+		return handOff(lower, upper);
+  }
 
   //
-  // insert
+  // join
   //
-  // Inserts the given key into the tree; if the key has already been insert then
-  // the function returns without changing the tree.  Rotations are performed
-  // as necessary to keep the tree balanced according to AVL definition.
+  // Moves every key of other into this tree, other's keys all being
+  // above this tree's; other is left empty. The two trees are joined by
+  // height, O(lgN), and the smaller one's nodes are moved into the pool
+  // of the larger. If the keys turn out to overlap, this is a merge()
+  // instead (and other is still emptied).
   //
-  // Time complexity:  O(lgN) worst-case
+  // Time complexity:  O(lgN + K), K the # of keys in the smaller tree
   //
-	
-	void insert(KeyT key, ValueT value)
-	{
-		NODE* prev = nullptr;
-		NODE* cur = ogRoot;
-		stack<NODE*> nodes;
-		
-		bool goRight = false;
-		bool goLeft = false;
-	
-		
-		while (cur != nullptr)
-		{  
+  void join(avlt& other)
+  {
+    if(this == &other || other.Size == 0)
+      return;
 		
-			if (key == cur->Key)  // already in tree
-				return;
-				
-			else if (key < cur->Key)  // search left:
-			{
-				prev = cur;
-				nodes.push(cur);
-				cur = cur->Left;
-				if(cur == nullptr)  // if cur is nullptr after moving left, it shouldnt be trying
-					goLeft = true;    // to insert on the left side of this. it just fell out
-			}
-			else  //search right
+		if(Size > 0)
+		{
+			NODE* last = ogRoot;
+			while(rightChild(last) != nullptr)
+				last = rightChild(last);
+			
+			if(!Less(last->Key, leftmost(other.ogRoot)->Key))
 			{
-				if(cur->isThreaded) // if it hits this point and it's threaded and the key is greater
-				{                   // than the current node, it wont go back up the tree. it will
-					prev = cur;       // just insert on the right and make it unthreaded
-					nodes.push(cur);
-					cur = nullptr;
-					goRight = true;
-					break;
-				}
-				else 
-				{
-					
-					prev = cur;
-					nodes.push(cur);
-					cur = cur->Right;
-					if(cur == nullptr) // if cur is nullptr after moving right, it shouldnt be trying
-						goRight = true;  // to insert on the right of this. it just fell out here
-				}
-					
+				merge(other);
+				other.clear();
+				return;
 			}
-			
-		} //while
-		
-		// creating new node to insert in the tree...
-		NODE* newNode = new NODE();
-
-		newNode->Key = key;
-		newNode->Value = value;
-		newNode->Left = nullptr;
-		newNode->Right = nullptr;
-		newNode->Height = 0;
+		}
 		
-		// Determining if its a new tree,
-		if (prev == nullptr)
+		NODE* left = ogRoot;
+		NODE* right = other.ogRoot;
+		if(other.Size > Size && Pool.get_allocator() == other.Pool.get_allocator())
 		{
-		   Root = newNode;
-			 ogRoot = Root;
-			 //nodes.push(newNode);
+			Pool.swap(other.Pool);  // other's nodes are this tree's now, and the other way around
+			NODE* moved = relocateTree(left, nullptr);
+			other.destroySubtree(left);
+			left = moved;
 		}
-		
-		// or a new node thats to the left of where it fell out,
-		if(goLeft)
+		else
 		{
-			newNode->Right = prev;
-			prev->Left = newNode;
-			//nodes.push(newNode);
-			newNode->isThreaded = true;
+			NODE* moved = relocateTree(right, nullptr);
+			other.destroySubtree(right);
+			right = moved;
 		}
 		
-		// or a node to the right of where it fell out.
-		if(goRight)
-		{
-			newNode->Right = prev->Right;
-			prev->Right = newNode;
-			//nodes.push(newNode);
-			prev->isThreaded = false;     // dethreaded prev if it is going to be inserted on the right of prev
-			
-			if(newNode->Right != nullptr) // if prev was pointing at something, it uses its right to point there
-				newNode->isThreaded = true;
-			else
-				newNode->isThreaded = false; // and if it wasn't, then it just makes 
-		}                                // it null (could be on the right of the tree)
+		Root = joinPair(left, right);
+		ogRoot = Root;
+		clearLastThread(Root);
+		Size += other.Size;
+		Cursor = nullptr;
+		hasBegun = false;
 		
-		Size++;
+		other.Root = nullptr;
+		other.ogRoot = nullptr;
+		other.Size = 0;
+		other.Cursor = nullptr;
+		other.hasBegun = false;
+  }
+
+  //
+  // erase_range
+  //
+  // Removes every key in the range [lower..upper], inclusive, and
+  // returns how many there were. The range is cut out with two splits
+  // and the rest joined back together, so nothing is searched key by
+  // key; the removed nodes go onto the pool's free list, ready for the
+  // next inserts.
+  //
+  // Time complexity:  O(lgN + K), where K is the # of keys removed
+  //
+  int erase_range(const KeyT& lower, const KeyT& upper)
+  {
+    if(ogRoot == nullptr || Less(upper, lower))
+      return 0;
 		
-		// balance time
+		NODE* below;
+		NODE* first;
+		NODE* middle;
+		NODE* last;
+		NODE* above;
+		
+		splitNodes(ogRoot, lower, below, first, middle);
+		splitNodes(middle, upper, middle, last, above);
 		
-		checkBalance(nodes, key);
+		DropList dropped;
+		dropped.pushSubtree(middle);
+		if(first != nullptr)
+			dropped.push(first);
+		if(last != nullptr)
+			dropped.push(last);
+		
+		Root = joinPair(below, above);
+		ogRoot = Root;
+		clearLastThread(Root);
+		Size -= (int) dropped.Count;
+		Cursor = nullptr;
+		hasBegun = false;
+		
+		int count = (int) dropped.Count;
+		destroyDropped(dropped);
+		return count;
+  }
 
-	}
+  //
+  // extract_range
+  //
+  // Same as erase_range, but the keys in [lower..upper] and their values
+  // are returned as a tree of their own, moved there as split() does.
+  //
+  // Time complexity:  O(lgN + min(K, N-K)), where K is the # of keys
+  //                   in the range
+  //
+  avlt extract_range(const KeyT& lower, const KeyT& upper)
+  {
+    if(ogRoot == nullptr || Less(upper, lower))
+      return avlt(Less, Pool.get_allocator());
+		
+		NODE* below;
+		NODE* first;
+		NODE* middle;
+		NODE* last;
+		NODE* above;
+		
+		splitNodes(ogRoot, lower, below, first, middle);
+		splitNodes(middle, upper, middle, last, above);
+		
+		if(first != nullptr)
+			middle = joinNodes(nullptr, first, middle);
+		if(last != nullptr)
+			middle = joinThreaded(middle, last, nullptr);
+		
+		return handOff(joinPair(below, above), middle);
+  }
 
   //
   // []
@@ -815,28 +3681,22 @@ public:
   //
   // Time complexity:  O(lgN) worst-case
   //
-  ValueT operator[](KeyT key) const
+  ValueT operator[](const KeyT& key) const
 	{
-    NODE* cur = ogRoot;
-		while(cur != nullptr) // performs a search for the node with a key
-		{
-			if(key == cur->Key)
-				return cur->Value;
-				
-			if(key < cur->Key)
-				cur = cur->Left;
-				
-			else
-			{
-				if(cur->isThreaded)  // if the key is greater than the nodes key and its 
-					return ValueT{};   // threaded, then the (key,value) node D.N.E.
-				else      
-					cur = cur->Right;
-			}
-		}
-		
+    NODE* cur = findNode(key);
+		if(cur == nullptr)  // not found, returns default
+			return ValueT{ };
+		return cur->Value;
+	}
 
-		return ValueT{ }; // if cur went to nullptr, it returns default
+  // with a transparent Compare, key can be anything Compare takes
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  ValueT operator[](const K& key) const
+	{
+    NODE* cur = findNode(key);
+		if(cur == nullptr)  // not found, returns default
+			return ValueT{ };
+		return cur->Value;
 	}
 
   //
@@ -852,46 +3712,12 @@ public:
   //
   // Time complexity:  O(lgN) worst-case
   //
-  KeyT operator()(KeyT key) const
+  KeyT operator()(const KeyT& key) const
 	{
-    //
-    // TODO
-    //
-
-    NODE* cur = ogRoot;
-		
-		if(ogRoot == nullptr) // if the real root d.n.e, there wont be one
-		{                     // to the right
+    NODE* cur = findNode(key);
+		if(cur == nullptr || cur->Right == nullptr)  // not found, or nothing to the right
 			return KeyT{};
-		}
-		
-		cur = ogRoot;   // starts from the top of the tree
-
-		while(cur != nullptr){
-			if(key == cur->Key)
-			{
-				if(cur->Right != nullptr)      // found, return the value to the right
-					return cur->Right->Key;   
-				else
-					return KeyT{};            // found, but the right node is null
-			} 
-			else if(key < cur->Key)
-			{
-				cur = cur->Left;  
-			}
-			else 
-			{
-				if(cur->isThreaded){
-					return KeyT{};        // if it didnt find it, and its threaded
-				}                       // dont go back, return default Key{}T
-				else 
-				{
-					cur = cur->Right;
-				}
-			}
-		}
-
-			return KeyT{};       // if cur went to nullptr, return default
+		return cur->Right->Key;
 	}
 
   //
@@ -904,40 +3730,217 @@ public:
   //
   // Time complexity:  O(lgN) worst-case
   //
-  int operator%(KeyT key) const
+  int operator%(const KeyT& key) const
   {
-    NODE* cur = Root;
+    NODE* cur = findNode(key);
 		if(cur == nullptr)
-		{
 			return -1;
+		return cur->Height;
+  }
+
+  //
+  // const_iterator
+  //
+  // Forward iterator over the tree in key order; *it is the key, and
+  // it.key() / it.value() give the key and value. Each iterator keeps its
+  // own position, so any number of scans can run at once, even on a const
+  // tree, and none of them touch the tree itself. Stepping follows the
+  // right-threads. An iterator stays valid until its own node is erased.
+  //
+  class const_iterator
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef KeyT                      value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const KeyT*               pointer;
+    typedef const KeyT&               reference;
+
+    const_iterator() : Node(nullptr) { }
+
+    reference operator*() const { return Node->Key; }
+    pointer operator->() const { return &Node->Key; }
+
+    const KeyT& key() const { return Node->Key; }
+    const ValueT& value() const { return Node->Value; }
+
+    // Time complexity:  O(1) amortized, O(lgN) worst-case
+    const_iterator& operator++()
+    {
+      Node = successor(Node);
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      const_iterator old = *this;
+      Node = successor(Node);
+      return old;
+    }
+
+    bool operator==(const const_iterator& other) const { return Node == other.Node; }
+    bool operator!=(const const_iterator& other) const { return Node != other.Node; }
+
+  private:
+    friend class avlt;
+
+    explicit const_iterator(NODE* node) : Node(node) { }
+
+    NODE* Node;  // nullptr once past the last key
+  };
+
+  //
+  // cbegin / cend
+  //
+  // Iterators to the first key and to one past the last key.
+  //
+  // Time complexity:  O(lgN) / O(1)
+  //
+  const_iterator cbegin() const
+  {
+    return const_iterator(leftmost(ogRoot));
+  }
+
+  const_iterator cend() const
+  {
+    return const_iterator();
+  }
+
+  //
+  // find
+  //
+  // Returns an iterator to the given key, or cend() if it's not in the tree.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  const_iterator find(const KeyT& key) const
+  {
+    return const_iterator(findNode(key));
+  }
+
+  // with a transparent Compare, key can be anything Compare takes
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K& key) const
+  {
+    return const_iterator(findNode(key));
+  }
+
+  //
+  // lower_bound / upper_bound
+  //
+  // Returns an iterator to the first key >= key (lower_bound) or > key
+  // (upper_bound), or cend() if there is none.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  const_iterator lower_bound(const KeyT& key) const
+  {
+    return const_iterator(lowerNode(key));
+  }
+
+  const_iterator upper_bound(const KeyT& key) const
+  {
+    return const_iterator(upperNode(key));
+  }
+
+  // with a transparent Compare, key can be anything Compare takes
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K& key) const
+  {
+    return const_iterator(lowerNode(key));
+  }
+
+  template<typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K& key) const
+  {
+    return const_iterator(upperNode(key));
+  }
+
+#ifdef AVLT_ORDER_STATISTICS
+  //
+  // rank
+  //
+  // Returns the # of keys in the tree that are less than key, which is
+  // also the position key has (or would have) in sorted order.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  int rank(const KeyT& key) const
+  {
+    return countBelow(key, false);
+  }
+
+  //
+  // select
+  //
+  // Returns an iterator to the i-th smallest key, counting from 0, or
+  // cend() if i is not less than size().
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  const_iterator select(int i) const
+  {
+    NODE* cur = ogRoot;
+		while(cur != nullptr)
+		{
+			int left = subtreeCount(cur->Left);
+			if(i < left)
+				cur = cur->Left;
+			else if(i == left)
+				return const_iterator(cur);
+			else
+			{
+				i -= left + 1;
+				cur = cur->isThreaded ? nullptr : cur->Right;
+			}
 		}
+		return cend();
+  }
+
+  //
+  // range_count
+  //
+  // Returns the # of keys in the range from lower to upper, with bounds as
+  // for range_for_each, without visiting them.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  int range_count(const KeyT& lower, const KeyT& upper, range_bounds bounds = closed) const
+  {
+    bool lowerOpen = (bounds == left_open || bounds == open);
+		bool upperOpen = (bounds == half_open || bounds == open);
 		
-		
-		while(cur != nullptr) // while cur is still a node
+		int count = countBelow(upper, !upperOpen) - countBelow(lower, lowerOpen);
+		return (count > 0) ? count : 0;
+  }
+
+private:
+
+	/* countBelow()
+	 * 
+	 * # of keys < key, or <= key if orEqual. Every time the descent goes
+	 * right, the node and everything on its left are below key.
+	 */
+	
+	int countBelow(const KeyT& key, bool orEqual) const
+	{
+		int count = 0;
+		NODE* cur = ogRoot;
+		while(cur != nullptr)
 		{
-			if(key == cur->Key) // checks if the key is found
-			{
-				return cur->Height;     // returns true if so and updates value
-			} 
-			else if(key < cur->Key)
+			if(orEqual ? !Less(key, cur->Key) : Less(cur->Key, key))
 			{
-				cur = cur->Left;    // if cur->Key is bigger, it moves left (to a smaller)
-			}                     // value and then runs the loop again
-			else 
-			{
-				if(cur->isThreaded){ 
-					return -1;    // if the node is threaded but the key its trying to find is bigger
-				}                  // it returns false because we dont need to go back up the tree. 
-				else  
-				{
-					if(key > cur->Key)  // if its not threaded and the key is bigger than the node's key
-						cur = cur->Right; // it moves right to a node with a greater value
-				}
+				count += subtreeCount(cur->Left) + 1;
+				cur = cur->isThreaded ? nullptr : cur->Right;
 			}
+			else
+				cur = cur->Left;
 		}
+		return count;
+	}
 
-    return -1;
-  }
+public:
+#endif
 
   //
   // begin
@@ -945,7 +3948,9 @@ public:
   // Resets internal state for an inorder traversal.  After the 
   // call to begin(), the internal state denotes the first inorder
   // key; this ensure that first call to next() function returns
-  // the first inorder key.
+  // the first inorder key. The position is kept apart from Root, so
+  // searches still work in the middle of a traversal; for several
+  // scans at once, use const_iterator instead.
   //
   // Space complexity: O(1)
   // Time complexity:  O(lgN) worst-case
@@ -957,17 +3962,7 @@ public:
   //
   void begin()
 	{
-		if(ogRoot == nullptr){
-			return;
-		}
-		
-		Root = ogRoot; // moving root back to the original spot
-		
-		while(Root->Left != nullptr) // and then moving all the way left
-		{                            // to first inorder node
-			Root = Root->Left;
-		}
-		
+		Cursor = leftmost(ogRoot); // first inorder node
 		hasBegun = true; // lets the tree know it has used begin() so it may use next()
     return;
 	}
@@ -986,7 +3981,7 @@ public:
   // inorder traversal.
   //
   // Space complexity: O(1)
-  // Time complexity:  O(lgN) worst-case
+  // Time complexity:  O(1) amortized, O(lgN) worst-case
   //
   // Example usage:
   //    tree.begin();
@@ -995,25 +3990,14 @@ public:
   //
   bool next(KeyT& key)
 	{
-    //
-    // TODO
-    //
-    if(Root == nullptr || hasBegun == false) // checks that it can use the function
+    if(Cursor == nullptr || hasBegun == false) // checks that it can use the function
 		{
 			return false;
 		}
 	
-		key = Root->Key;         // updates key to current Root's key
-		Root = Root->Right;      // moves the Root to the right no matter what
-		
-		if(Root != nullptr){                                     // now it checks if it can move left
-			while(Root->Left != nullptr && Root->Left->Key > key)  // so it gets the next inorder value 
-			{                                                      // and then it will move if the left values
-				Root = Root->Left;                                   // are greater than the key it updated
-			}
-		}
+		key = Cursor->Key;            // updates key to the current node's key
+		Cursor = successor(Cursor);   // and moves on to the next inorder node
 		return true;
-		
 	}
 
 
@@ -0,0 +1,383 @@
+/*avlt_bench.cpp*/
+
+//
+// Times avlt against std::map on the same work, and writes the results
+// as JSON so runs from different versions can be compared.
+//
+// usage: avlt_bench [--min-size N] [--max-size N] [--repeat R] [--out FILE]
+//
+// Sizes go up by 10x from --min-size (default 1000) to --max-size
+// (default 1000000; the full sweep goes to 100000000, which needs a lot
+// of memory for the string keys). Every timing is the best of --repeat
+// runs (default 3). Results go to FILE (default avlt_bench.json) and a
+// summary to the console.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "avlt.h"
+
+using namespace std;
+
+struct Options
+{
+  size_t MinSize = 1000;
+  size_t MaxSize = 1000000;
+  int    Repeat = 3;
+  string Out = "avlt_bench.json";
+};
+
+struct Result
+{
+  string Container;
+  string KeyType;
+  string Operation;
+  size_t Size;
+  size_t Ops;
+  double NsPerOp;
+};
+
+// 256 bytes of value per key, for the large_value runs
+struct LargeValue
+{
+  int64_t Words[32];
+
+  LargeValue() { memset(Words, 0, sizeof(Words)); }
+  explicit LargeValue(int64_t i) { memset(Words, 0, sizeof(Words)); Words[0] = i; }
+};
+
+// keeps the optimizer from dropping work whose result is never used
+static volatile uint64_t Sink;
+
+static void consume(int value) { Sink = Sink + (uint64_t) value; }
+static void consume(const string& value) { Sink = Sink + value.size(); }
+static void consume(const LargeValue& value) { Sink = Sink + (uint64_t) value.Words[0]; }
+
+// the i-th smallest key; keys are spaced out so ranges can fall between them
+static int makeKey(size_t i, int*) { return (int) (2 * i); }
+
+static string makeKey(size_t i, string*)
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "user:%016zu", 2 * i);  // too long for the small string buffer
+  return string(buffer);
+}
+
+static int makeValue(size_t i, int*) { return (int) i; }
+static LargeValue makeValue(size_t i, LargeValue*) { return LargeValue((int64_t) i); }
+
+//
+// Timer: best of several runs of one operation
+//
+class Timer
+{
+public:
+  Timer() : Best(-1) { }
+
+  void start() { Start = chrono::steady_clock::now(); }
+
+  void stop()
+  {
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - Start).count();
+    if(Best < 0 || ns < Best)
+      Best = ns;
+  }
+
+  double best() const { return Best; }
+
+private:
+  chrono::steady_clock::time_point Start;
+  double Best;
+};
+
+//
+// Work: the inputs every container gets, in the same order
+//
+template<typename KeyT, typename ValueT>
+struct Work
+{
+  vector<KeyT>   InsertKeys;   // every key, shuffled
+  vector<ValueT> Values;       // Values[i] goes with InsertKeys[i]
+  vector<KeyT>   LookupKeys;   // keys to search for, shuffled, all present
+  vector<pair<KeyT, KeyT>> Ranges;  // [lower, upper] ranges of about RangeWidth keys
+
+  static constexpr size_t RangeWidth = 100;
+  static constexpr size_t MaxLookups = 1 << 20;
+  static constexpr size_t MaxRanges = 1 << 12;
+
+  explicit Work(size_t n)
+  {
+    mt19937_64 rng(n);
+
+    vector<size_t> order(n);
+    for(size_t i = 0; i < n; i++)
+      order[i] = i;
+    shuffle(order.begin(), order.end(), rng);
+
+    for(size_t i = 0; i < n; i++)
+    {
+      InsertKeys.push_back(makeKey(order[i], (KeyT*) nullptr));
+      Values.push_back(makeValue(order[i], (ValueT*) nullptr));
+    }
+
+    size_t lookups = min(n, MaxLookups);
+    for(size_t i = 0; i < lookups; i++)
+      LookupKeys.push_back(InsertKeys[rng() % n]);
+
+    size_t ranges = min(n, MaxRanges);
+    for(size_t i = 0; i < ranges; i++)
+    {
+      size_t first = rng() % n;
+      Ranges.push_back(make_pair(makeKey(first, (KeyT*) nullptr),
+                                 makeKey(first + RangeWidth - 1, (KeyT*) nullptr)));
+    }
+  }
+};
+
+//
+// benchAvlt / benchMap
+//
+// run the same operations on avlt and on std::map. Where std::map has
+// no direct counterpart (search, [], range_search, begin/next) the
+// closest equivalent is timed: find, find with a default, a
+// lower_bound..upper_bound scan into a vector, and a plain loop.
+//
+template<typename KeyT, typename ValueT>
+static void benchAvlt(const Work<KeyT, ValueT>& work, const char* keyType, const Options& options,
+                      vector<Result>& results)
+{
+  size_t n = work.InsertKeys.size();
+  Timer insert, search, index, range, iterate, copy, clear;
+
+  for(int run = 0; run < options.Repeat; run++)
+  {
+    avlt<KeyT, ValueT> tree;
+
+    insert.start();
+    for(size_t i = 0; i < n; i++)
+      tree.insert(work.InsertKeys[i], work.Values[i]);
+    insert.stop();
+
+    search.start();
+    for(const KeyT& key : work.LookupKeys)
+    {
+      ValueT value;
+      if(tree.search(key, value))
+        consume(value);
+    }
+    search.stop();
+
+    index.start();
+    for(const KeyT& key : work.LookupKeys)
+      consume(tree[key]);
+    index.stop();
+
+    range.start();
+    for(const auto& r : work.Ranges)
+      Sink = Sink + tree.range_search(r.first, r.second).size();
+    range.stop();
+
+    iterate.start();
+    KeyT key;
+    tree.begin();
+    while(tree.next(key))
+      consume(key);
+    iterate.stop();
+
+    copy.start();
+    avlt<KeyT, ValueT> other(tree);
+    copy.stop();
+    Sink = Sink + other.size();
+
+    clear.start();
+    other.clear();
+    clear.stop();
+  }
+
+  results.push_back({"avlt", keyType, "insert", n, n, insert.best() / n});
+  results.push_back({"avlt", keyType, "search", n, work.LookupKeys.size(), search.best() / work.LookupKeys.size()});
+  results.push_back({"avlt", keyType, "operator[]", n, work.LookupKeys.size(), index.best() / work.LookupKeys.size()});
+  results.push_back({"avlt", keyType, "range_search", n, work.Ranges.size(), range.best() / work.Ranges.size()});
+  results.push_back({"avlt", keyType, "begin_next", n, n, iterate.best() / n});
+  results.push_back({"avlt", keyType, "copy", n, n, copy.best() / n});
+  results.push_back({"avlt", keyType, "clear", n, n, clear.best() / n});
+}
+
+template<typename KeyT, typename ValueT>
+static void benchMap(const Work<KeyT, ValueT>& work, const char* keyType, const Options& options,
+                     vector<Result>& results)
+{
+  size_t n = work.InsertKeys.size();
+  Timer insert, search, index, range, iterate, copy, clear;
+
+  for(int run = 0; run < options.Repeat; run++)
+  {
+    map<KeyT, ValueT> tree;
+
+    insert.start();
+    for(size_t i = 0; i < n; i++)
+      tree.emplace(work.InsertKeys[i], work.Values[i]);
+    insert.stop();
+
+    search.start();
+    for(const KeyT& key : work.LookupKeys)
+    {
+      auto it = tree.find(key);
+      if(it != tree.end())
+        consume(it->second);
+    }
+    search.stop();
+
+    index.start();
+    for(const KeyT& key : work.LookupKeys)
+    {
+      auto it = tree.find(key);
+      consume(it == tree.end() ? ValueT{} : it->second);
+    }
+    index.stop();
+
+    range.start();
+    for(const auto& r : work.Ranges)
+    {
+      vector<KeyT> keys;
+      for(auto it = tree.lower_bound(r.first); it != tree.end() && !(r.second < it->first); ++it)
+        keys.push_back(it->first);
+      Sink = Sink + keys.size();
+    }
+    range.stop();
+
+    iterate.start();
+    for(const auto& p : tree)
+      consume(p.first);
+    iterate.stop();
+
+    copy.start();
+    map<KeyT, ValueT> other(tree);
+    copy.stop();
+    Sink = Sink + other.size();
+
+    clear.start();
+    other.clear();
+    clear.stop();
+  }
+
+  results.push_back({"std::map", keyType, "insert", n, n, insert.best() / n});
+  results.push_back({"std::map", keyType, "search", n, work.LookupKeys.size(), search.best() / work.LookupKeys.size()});
+  results.push_back({"std::map", keyType, "operator[]", n, work.LookupKeys.size(), index.best() / work.LookupKeys.size()});
+  results.push_back({"std::map", keyType, "range_search", n, work.Ranges.size(), range.best() / work.Ranges.size()});
+  results.push_back({"std::map", keyType, "begin_next", n, n, iterate.best() / n});
+  results.push_back({"std::map", keyType, "copy", n, n, copy.best() / n});
+  results.push_back({"std::map", keyType, "clear", n, n, clear.best() / n});
+}
+
+template<typename KeyT, typename ValueT>
+static void benchKeyType(const char* keyType, const Options& options, vector<Result>& results)
+{
+  for(size_t n = options.MinSize; n <= options.MaxSize; n *= 10)
+  {
+    Work<KeyT, ValueT> work(n);
+
+    size_t first = results.size();
+    benchAvlt(work, keyType, options, results);
+    benchMap(work, keyType, options, results);
+
+    for(size_t i = first; i < results.size(); i++)
+      printf("%-9s %-12s %-13s %10zu %12.1f ns/op\n", results[i].Container.c_str(), keyType,
+             results[i].Operation.c_str(), n, results[i].NsPerOp);
+    fflush(stdout);
+  }
+}
+
+static bool writeJson(const Options& options, const vector<Result>& results)
+{
+  FILE* out = fopen(options.Out.c_str(), "w");
+  if(out == nullptr)
+    return false;
+
+#ifdef __VERSION__
+  const char* compiler = __VERSION__;
+#else
+  const char* compiler = "unknown";
+#endif
+#ifdef NDEBUG
+  const char* build = "release";
+#else
+  const char* build = "debug";
+#endif
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"context\": {\n");
+  fprintf(out, "    \"compiler\": \"%s\",\n", compiler);
+  fprintf(out, "    \"build\": \"%s\",\n", build);
+  fprintf(out, "    \"repeat\": %d,\n", options.Repeat);
+  fprintf(out, "    \"timing\": \"best of repeat, nanoseconds per operation\"\n");
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"benchmarks\": [\n");
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    const Result& r = results[i];
+    fprintf(out, "    {\"container\": \"%s\", \"key_type\": \"%s\", \"operation\": \"%s\", "
+                 "\"size\": %zu, \"ops\": %zu, \"ns_per_op\": %.3f}%s\n",
+            r.Container.c_str(), r.KeyType.c_str(), r.Operation.c_str(), r.Size, r.Ops, r.NsPerOp,
+            (i + 1 < results.size()) ? "," : "");
+  }
+  fprintf(out, "  ]\n");
+  fprintf(out, "}\n");
+
+  return fclose(out) == 0;
+}
+
+static bool parseArgs(int argc, char* argv[], Options& options)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    if(i + 1 >= argc)
+      return false;
+
+    const char* value = argv[++i];
+    if(arg == "--min-size")
+      options.MinSize = strtoull(value, nullptr, 10);
+    else if(arg == "--max-size")
+      options.MaxSize = strtoull(value, nullptr, 10);
+    else if(arg == "--repeat")
+      options.Repeat = atoi(value);
+    else if(arg == "--out")
+      options.Out = value;
+    else
+      return false;
+  }
+  return options.MinSize > 0 && options.Repeat > 0;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if(!parseArgs(argc, argv, options))
+  {
+    fprintf(stderr, "usage: %s [--min-size N] [--max-size N] [--repeat R] [--out FILE]\n", argv[0]);
+    return 2;
+  }
+
+  vector<Result> results;
+  benchKeyType<int, int>("int", options, results);
+  benchKeyType<string, int>("string", options, results);
+  benchKeyType<int, LargeValue>("large_value", options, results);
+
+  if(!writeJson(options, results))
+  {
+    fprintf(stderr, "could not write %s\n", options.Out.c_str());
+    return 1;
+  }
+  printf("results written to %s\n", options.Out.c_str());
+  return 0;
+}
@@ -0,0 +1,606 @@
+/*compact_avlt.h*/
+
+//
+// Threaded AVL tree stored in one array, linked by 32-bit indices
+//
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+//
+// compact_avlt is the same right-threaded AVL tree as avlt, laid out for
+// size: the nodes sit next to each other in one vector, children and
+// threads are 32-bit indices into it instead of 64-bit pointers, and the
+// height and thread flag share a single byte. For int keys and values a
+// node takes 20 bytes instead of avlt's 32, so about half again as many
+// fit per cache line and per GB. Erased nodes are kept on a free list and
+// reused by later inserts.
+//
+// Holds at most INT_MAX keys, the most size() can count; the node array,
+// erased nodes included, stops growing there too, so an index never runs
+// into Nil. An insert that would need more throws std::length_error.
+//
+template<typename KeyT, typename ValueT>
+class compact_avlt
+{
+private:
+  typedef uint32_t index;
+
+  static const index   Nil        = 0xFFFFFFFFu;  // "no node"
+  static const uint8_t ThreadBit  = 0x80;         // set => Right is a thread
+  static const uint8_t HeightMask = 0x7F;         // height of tree rooted here
+  static const int     MaxPath    = 64;           // deeper than any AVL tree of < 2^32 nodes
+  static const size_t  MaxNodes   = INT_MAX;      // Size is an int, and stays below Nil
+
+  struct NODE
+  {
+    KeyT    Key;
+    ValueT  Value;
+    index   Left;
+    index   Right;
+    uint8_t Meta;  // ThreadBit | height
+  };
+
+  vector<NODE> Nodes;  // every node, erased ones included
+  index Root;          // index of root node of tree (Nil if empty)
+  index FreeList;      // erased nodes, linked through Left
+  int   Size;          // # of nodes in the tree (0 if empty)
+  index Cursor;        // next node begin()/next() will return
+  bool  hasBegun;      // Checks whether or not the tree has called begin()
+
+	/* small accessors, so the code below reads like avlt's */
+
+	bool isThreaded(index i) const
+	{
+		return (Nodes[i].Meta & ThreadBit) != 0;
+	}
+
+	void setThreaded(index i, bool threaded)
+	{
+		Nodes[i].Meta = (uint8_t) ((Nodes[i].Meta & HeightMask) | (threaded ? ThreadBit : 0));
+	}
+
+	int height(index i) const
+	{
+		return (i == Nil) ? -1 : (Nodes[i].Meta & HeightMask);
+	}
+
+	// right child, or Nil if Right is a thread or the end of the tree
+	index rightChild(index i) const
+	{
+		return isThreaded(i) ? Nil : Nodes[i].Right;
+	}
+
+	/* fixHeight()
+	 *
+	 * recomputes a node's height from its children, and returns true if
+	 * it changed
+	 */
+
+	bool fixHeight(index i)
+	{
+		int h = 1 + max(height(Nodes[i].Left), height(rightChild(i)));
+		if(h == height(i))
+			return false;
+
+		Nodes[i].Meta = (uint8_t) ((Nodes[i].Meta & ThreadBit) | h);
+		return true;
+	}
+
+	int balance(index i) const
+	{
+		return height(Nodes[i].Left) - height(rightChild(i));
+	}
+
+	/* newNode()
+	 *
+	 * a leaf for key, from the free list if there is one. Throws
+	 * std::length_error, leaving the tree as it was, once the array
+	 * already holds MaxNodes nodes.
+	 */
+
+	index newNode(const KeyT& key, const ValueT& value)
+	{
+		NODE node = { key, value, Nil, Nil, 0 };
+
+		if(FreeList != Nil)
+		{
+			index i = FreeList;
+			FreeList = Nodes[i].Left;
+			Nodes[i] = node;
+			return i;
+		}
+
+		if(Nodes.size() >= MaxNodes)
+			throw std::length_error("compact_avlt: more than INT_MAX nodes");
+
+		Nodes.push_back(node);
+		return (index) (Nodes.size() - 1);
+	}
+
+	/* right_rotate() / left_rotate()
+	 *
+	 * same rotations as avlt's, with indices. They return the new top of
+	 * the subtree, and the caller links it into the parent.
+	 */
+
+	index right_rotate(index cur)
+	{
+		index cl = Nodes[cur].Left;
+
+		Nodes[cur].Left = rightChild(cl);  // cl's right subtree moves under cur
+		Nodes[cl].Right = cur;
+		setThreaded(cl, false);
+
+		fixHeight(cur);
+		fixHeight(cl);
+		return cl;
+	}
+
+	index left_rotate(index cur)
+	{
+		index cr = Nodes[cur].Right;
+		index crL = Nodes[cr].Left;
+
+		Nodes[cr].Left = cur;
+		if(crL == Nil)  // nothing moves under cur, so it threads to cr
+		{
+			Nodes[cur].Right = cr;
+			setThreaded(cur, true);
+		}
+		else
+			Nodes[cur].Right = crL;
+
+		fixHeight(cur);
+		fixHeight(cr);
+		return cr;
+	}
+
+	/* rebalance()
+	 *
+	 * rotates the subtree at cur if it is out of balance, and returns its
+	 * (possibly new) top
+	 */
+
+	index rebalance(index cur)
+	{
+		int b = balance(cur);
+
+		if(b >= 2)
+		{
+			if(balance(Nodes[cur].Left) < 0)  //Left Right Rotate
+				Nodes[cur].Left = left_rotate(Nodes[cur].Left);
+			return right_rotate(cur);
+		}
+		if(b <= -2)
+		{
+			if(balance(Nodes[cur].Right) > 0)  //Right Left Rotate
+				Nodes[cur].Right = right_rotate(Nodes[cur].Right);
+			return left_rotate(cur);
+		}
+		return cur;
+	}
+
+	// points par at child instead of old (or Root, if par is Nil)
+	void relink(index par, index old, index child)
+	{
+		if(par == Nil)
+			Root = child;
+		else if(Nodes[par].Left == old)
+			Nodes[par].Left = child;
+		else if(Nodes[par].Right == old)
+			Nodes[par].Right = child;
+	}
+
+	/* fixUp()
+	 *
+	 * walks back up the ancestors in path fixing heights and rotating.
+	 * After an insert the first rotation settles everything; after an
+	 * erase the walk goes on until a height stops changing.
+	 */
+
+	void fixUp(index* path, int depth, bool afterInsert)
+	{
+		for(int i = depth - 1; i >= 0; i--)
+		{
+			index cur = path[i];
+			bool changed = fixHeight(cur);
+			int b = balance(cur);
+
+			if(b >= -1 && b <= 1)
+			{
+				if(!changed)  // didn't change, so no need to go further
+					return;
+				continue;
+			}
+
+			relink((i > 0) ? path[i - 1] : Nil, cur, rebalance(cur));
+			if(afterInsert)
+				return;
+		}
+	}
+
+	index leftmost(index i) const
+	{
+		if(i != Nil)
+			while(Nodes[i].Left != Nil)
+				i = Nodes[i].Left;
+		return i;
+	}
+
+	index successor(index i) const
+	{
+		return isThreaded(i) ? Nodes[i].Right : leftmost(Nodes[i].Right);
+	}
+
+	/* findNode()
+	 *
+	 * one compare per level, like avlt's lowerNode(): the descent finds
+	 * the first node >= key, and only that node is checked for equality
+	 */
+
+	index findNode(const KeyT& key) const
+	{
+		index cur = Root;
+		index lower = Nil;  // first node >= key so far
+		while(cur != Nil)
+		{
+			if(!(Nodes[cur].Key < key))
+			{
+				lower = cur;
+				cur = Nodes[cur].Left;
+			}
+			else
+				cur = rightChild(cur);
+		}
+		return (lower != Nil && !(key < Nodes[lower].Key)) ? lower : Nil;
+	}
+
+public:
+
+  //
+  // default constructor:
+  //
+  // Creates an empty tree.
+  //
+  compact_avlt()
+  {
+    Root = Nil;
+    FreeList = Nil;
+    Size = 0;
+    Cursor = Nil;
+    hasBegun = false;
+  }
+
+  //
+  // clear:
+  //
+  // Clears the contents of the tree, resetting the tree to empty. The
+  // array keeps its capacity.
+  //
+  void clear()
+  {
+    Nodes.clear();
+    Root = Nil;
+    FreeList = Nil;
+    Size = 0;
+    Cursor = Nil;
+    hasBegun = false;
+  }
+
+  //
+  // reserve:
+  //
+  // Makes room for n nodes up front, so inserts don't have to grow the
+  // array.
+  //
+  void reserve(size_t n)
+  {
+    Nodes.reserve(n);
+  }
+
+  //
+  // size:
+  //
+  // Returns the # of nodes in the tree, 0 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int size() const
+  {
+    return Size;
+  }
+
+  //
+  // height:
+  //
+  // Returns the height of the tree, -1 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int height() const
+  {
+    return height(Root);
+  }
+
+  //
+  // memory_usage:
+  //
+  // Returns the bytes the tree holds: the object itself plus the whole
+  // node array, including spare capacity and erased nodes.
+  //
+  size_t memory_usage() const
+  {
+    return sizeof(*this) + Nodes.capacity() * sizeof(NODE);
+  }
+
+  //
+  // search:
+  //
+  // Searches the tree for the given key, returning true if found
+  // and false if not.  If the key is found, the corresponding value
+  // is returned via the reference parameter.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    index i = findNode(key);
+    if(i == Nil)
+      return false;
+
+    value = Nodes[i].Value;
+    return true;
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    index i = findNode(key);
+    return (i == Nil) ? ValueT{} : Nodes[i].Value;
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive, following the
+  // threads from the first one.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+
+    // smallest node >= lower
+    index cur = Root;
+    index node = Nil;
+    while(cur != Nil)
+    {
+      if(!(Nodes[cur].Key < lower))
+      {
+        node = cur;
+        cur = Nodes[cur].Left;
+      }
+      else
+        cur = rightChild(cur);
+    }
+
+    for(; node != Nil && !(upper < Nodes[node].Key); node = successor(node))
+      keys.push_back(Nodes[node].Key);
+
+    return keys;
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the tree; if the key has already been insert then
+  // the function returns without changing the tree.  Rotations are performed
+  // as necessary to keep the tree balanced according to AVL definition.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  void insert(const KeyT& key, const ValueT& value)
+  {
+    index path[MaxPath];
+    int depth = 0;
+    index cur = Root;
+    index lower = Nil;  // first node >= key so far, as in findNode()
+    bool goLeft = false;
+
+    while(cur != Nil)
+    {
+      path[depth++] = cur;
+      goLeft = !(Nodes[cur].Key < key);
+      if(goLeft)
+        lower = cur;
+      cur = goLeft ? Nodes[cur].Left : rightChild(cur);
+    }
+
+    if(lower != Nil && !(key < Nodes[lower].Key))  // already in tree
+      return;
+
+    index added = newNode(key, value);  // may move the array, so no references above
+
+    if(depth == 0)
+      Root = added;
+    else
+    {
+      index prev = path[depth - 1];
+      if(goLeft)
+      {
+        Nodes[added].Right = prev;
+        setThreaded(added, true);
+        Nodes[prev].Left = added;
+      }
+      else
+      {
+        Nodes[added].Right = Nodes[prev].Right;
+        setThreaded(added, Nodes[prev].Right != Nil);
+        Nodes[prev].Right = added;
+        setThreaded(prev, false);
+      }
+    }
+
+    Size++;
+    fixUp(path, depth, true);
+  }
+
+  //
+  // erase
+  //
+  // Removes the given key from the tree, returning true if it was found
+  // and false if not, the same way avlt::erase does.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool erase(const KeyT& key)
+  {
+    index path[MaxPath];
+    int depth = 0;
+    index cur = Root;
+    index lower = Nil;  // first node >= key so far, as in findNode()
+    int lowerDepth = 0;
+
+    while(cur != Nil)
+    {
+      if(!(Nodes[cur].Key < key))
+      {
+        lower = cur;
+        lowerDepth = depth;
+        path[depth++] = cur;
+        cur = Nodes[cur].Left;
+      }
+      else
+      {
+        path[depth++] = cur;
+        cur = rightChild(cur);
+      }
+    }
+
+    if(lower == Nil || key < Nodes[lower].Key)  // not in tree
+      return false;
+
+    cur = lower;
+    depth = lowerDepth;  // only the nodes above it are its ancestors
+
+    index par = (depth > 0) ? path[depth - 1] : Nil;
+    index right = rightChild(cur);
+    index replacement;
+
+    if(Nodes[cur].Left == Nil)
+    {
+      // nothing threads to cur. if it's a leaf on the right of its
+      // parent, the parent now threads to where cur did
+      replacement = right;
+      if(right == Nil && par != Nil && Nodes[par].Right == cur)
+      {
+        Nodes[par].Right = Nodes[cur].Right;
+        setThreaded(par, isThreaded(cur));
+      }
+    }
+    else if(right == Nil)
+    {
+      // cur's predecessor threads to cur; it now threads to where cur did
+      index pred = Nodes[cur].Left;
+      while(!isThreaded(pred))
+        pred = Nodes[pred].Right;
+
+      Nodes[pred].Right = Nodes[cur].Right;
+      setThreaded(pred, isThreaded(cur));
+      replacement = Nodes[cur].Left;
+    }
+    else
+    {
+      // swap in cur's predecessor, which has no right child
+      int curDepth = depth;
+      path[depth++] = cur;
+
+      index predPar = cur;
+      index pred = Nodes[cur].Left;
+      while(!isThreaded(pred))
+      {
+        path[depth++] = pred;
+        predPar = pred;
+        pred = Nodes[pred].Right;
+      }
+
+      if(predPar == cur)
+        Nodes[cur].Left = Nodes[pred].Left;
+      else if(Nodes[pred].Left != Nil)
+        Nodes[predPar].Right = Nodes[pred].Left;
+      else
+      {
+        Nodes[predPar].Right = pred;  // predPar's successor is pred again
+        setThreaded(predPar, true);
+      }
+
+      Nodes[pred].Left = Nodes[cur].Left;
+      Nodes[pred].Right = Nodes[cur].Right;
+      Nodes[pred].Meta = (uint8_t) height(cur);  // not threaded
+      path[curDepth] = pred;
+      replacement = pred;
+    }
+
+    relink(par, cur, replacement);
+
+    if(Cursor == cur)  // keep a begin()/next() scan going past it
+      Cursor = successor(cur);
+
+    Nodes[cur] = NODE{ KeyT{}, ValueT{}, FreeList, Nil, 0 };
+    FreeList = cur;
+    Size--;
+
+    fixUp(path, depth, false);
+    return true;
+  }
+
+  //
+  // begin
+  //
+  // Resets internal state for an inorder traversal, like avlt::begin.
+  //
+  // Example usage:
+  //    tree.begin();
+  //    while (tree.next(key))
+  //      cout << key << endl;
+  //
+  void begin()
+  {
+    Cursor = leftmost(Root);
+    hasBegun = true;
+  }
+
+  //
+  // next
+  //
+  // Returns the next inorder key via the reference parameter, or false
+  // once there are no more, like avlt::next.
+  //
+  // Time complexity:  O(1) amortized, O(lgN) worst-case
+  //
+  bool next(KeyT& key)
+  {
+    if(Cursor == Nil || hasBegun == false)
+      return false;
+
+    key = Nodes[Cursor].Key;
+    Cursor = successor(Cursor);
+    return true;
+  }
+};
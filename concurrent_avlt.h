@@ -0,0 +1,496 @@
+/*concurrent_avlt.h*/
+
+//
+// Threaded AVL tree for many readers and few writers
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "avlt.h"
+
+//
+// concurrent_avlt wraps an avlt so that lookups can run from any number of
+// threads without taking a lock, while writers take turns on a mutex.
+//
+// Every write makes Version odd while it runs and even again once it is
+// done. A reader notes an even Version, walks the tree without locking,
+// and then checks that Version hasn't moved. If it has, some write (an
+// insert and its rotations, an erase, ...) overlapped the walk, and the
+// reader simply tries again. After a few failed tries it waits for the
+// writers by taking the mutex, so readers can't starve.
+//
+// A reader that overlaps a write may see nodes halfway through being
+// relinked. That is still well defined, and safe, because:
+//   - the links and flags a reader follows are atomics (the tree is an
+//     avlt with SharedLinks on), which writers store with release and
+//     readers load with acquire, so a reader only ever reaches fully
+//     built nodes;
+//   - a node's key and value don't change while it is in the tree, and
+//     an erased node isn't given back to the pool until no lock-free read
+//     that may have reached it is still going (see reclaim()), so no key
+//     or value is ever written while a reader may be reading it;
+//   - walks are bounded, so a reader caught in a half-made cycle gives up
+//     and retries instead of spinning.
+// Readers announce themselves in per-thread slots, each on its own cache
+// line, and never write to anything shared with other readers or with
+// Version, so lookups on many cores don't slow each other down.
+// KeyT and ValueT must be trivially copyable, since clear() hands all the
+// nodes back to the pool at once without destroying them.
+//
+template<typename KeyT, typename ValueT, typename Compare = std::less<KeyT>,
+         typename Alloc = std::allocator<std::pair<const KeyT, ValueT>>>
+class concurrent_avlt
+{
+private:
+  static_assert(std::is_trivially_copyable<KeyT>::value &&
+                std::is_trivially_copyable<ValueT>::value,
+                "concurrent_avlt::clear() drops nodes without destroying them");
+
+  typedef avlt<KeyT, ValueT, Compare, Alloc, true> tree_type;
+  typedef typename tree_type::NODE NODE;
+
+  static const int OptimisticTries = 8;  // lock-free attempts before a reader takes the lock
+  static const int RangeCheckEvery = 64; // nodes a range scan visits between Version checks
+  static const size_t RetireBatch = 64;  // erased nodes a writer waits on readers for
+  static const size_t ReaderSlots = 64;  // threads beyond this many share slots
+
+  // lock-free reads in progress by the threads given this slot; on its
+  // own cache line, so readers on different slots never touch the same one
+  struct alignas(64) ReaderSlot
+  {
+    std::atomic<int> Active;
+  };
+
+  alignas(64) std::atomic<unsigned long> Version;  // odd while a write is in progress
+  alignas(64) mutable ReaderSlot Readers[ReaderSlots];
+  alignas(64) mutable std::mutex WriteLock;        // serializes writers, and readers that gave up
+  tree_type Tree;
+  vector<NODE*> Retired;                           // erased, not yet given back to the pool
+
+	/* readerSlot()
+	 *
+	 * the calling thread's slot in Readers; threads are handed slots in
+	 * turn as they first read, so the first ReaderSlots threads each get
+	 * their own
+	 */
+
+	static size_t readerSlot()
+	{
+		static std::atomic<size_t> nextSlot(0);
+		thread_local size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % ReaderSlots;
+		return slot;
+	}
+
+	/* clearReaders() / readersActive()
+	 *
+	 * start every reader slot at 0 / true if any thread has a lock-free
+	 * read in progress
+	 */
+
+	void clearReaders()
+	{
+		for(size_t i = 0; i < ReaderSlots; i++)
+			Readers[i].Active.store(0, std::memory_order_relaxed);
+	}
+
+	bool readersActive() const
+	{
+		for(size_t i = 0; i < ReaderSlots; i++)
+			if(Readers[i].Active.load(std::memory_order_seq_cst) != 0)
+				return true;
+		return false;
+	}
+
+	/* WriteGuard
+	 *
+	 * holds the writers' lock and keeps Version odd for the duration of a
+	 * write. The tree's links are stored with release, so none of the
+	 * changes can be seen before the odd Version, and the release store
+	 * at the end keeps them from being seen after the even one. The odd
+	 * Version is stored seq_cst for reclaim(), see ReadGuard.
+	 */
+
+	class WriteGuard
+	{
+	public:
+		explicit WriteGuard(concurrent_avlt& tree)
+			: Owner(tree), Lock(tree.WriteLock)
+		{
+			Owner.Version.store(Owner.Version.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+		}
+
+		~WriteGuard()
+		{
+			Owner.Version.store(Owner.Version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	private:
+		concurrent_avlt& Owner;
+		std::lock_guard<std::mutex> Lock;
+	};
+
+	/* ReadGuard
+	 *
+	 * counts a lock-free read in this thread's reader slot for as long as
+	 * it lasts, starting from a stable (even) Version once no write is in
+	 * progress. Version is checked again after the count goes up: a writer
+	 * stores its odd Version before it looks at the slots, both seq_cst,
+	 * so either the writer sees this read, or this read sees the write
+	 * and starts over.
+	 */
+
+	class ReadGuard
+	{
+	public:
+		explicit ReadGuard(const concurrent_avlt& tree)
+			: Slot(tree.Readers[readerSlot()].Active)
+		{
+			for(;;)
+			{
+				Start = tree.Version.load(std::memory_order_acquire);
+				if(Start & 1)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				Slot.fetch_add(1, std::memory_order_seq_cst);
+				if(tree.Version.load(std::memory_order_seq_cst) == Start)
+					return;
+				Slot.fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		~ReadGuard()
+		{
+			Slot.fetch_sub(1, std::memory_order_release);
+		}
+
+		unsigned long Start;  // the Version the read started from
+
+	private:
+		std::atomic<int>& Slot;
+	};
+
+	/* reclaim()
+	 *
+	 * for writers: gives the erased nodes back to the pool, once no
+	 * lock-free read is in progress, since one may have reached them
+	 * before they were taken out. While the write keeps Version odd no
+	 * new read gets going, and the ones in progress are bounded and give
+	 * up at their next Version check, so waiting for them is short. Only
+	 * looks once RetireBatch nodes have piled up, or when "all" is set,
+	 * since that means reading every reader slot.
+	 */
+
+	void reclaim(bool all)
+	{
+		if(!all && Retired.size() < RetireBatch)
+			return;
+
+		while(readersActive())
+			std::this_thread::yield();
+
+		for(size_t i = 0; i < Retired.size(); i++)
+			Tree.destroyNode(Retired[i]);
+		Retired.clear();
+	}
+
+	/* readValid()
+	 *
+	 * true if no write happened since a ReadGuard started from version, so
+	 * everything read in between is consistent. Readers load every link
+	 * and flag with acquire, so this load can't move ahead of any of them.
+	 */
+
+	bool readValid(unsigned long version) const
+	{
+		return Version.load(std::memory_order_acquire) == version;
+	}
+
+	/* findNode()
+	 *
+	 * same descent as avlt::search, but gives up (returning false) after
+	 * more steps than any balanced tree needs. found is nullptr if the key
+	 * isn't in the tree.
+	 */
+
+	bool findNode(const KeyT& key, const NODE*& found) const
+	{
+		const NODE* cur = Tree.ogRoot.load(std::memory_order_acquire);
+		const NODE* lower = nullptr;  // first node >= key so far
+
+		for(int steps = 0; steps < tree_type::MaxPath; steps++)
+		{
+			if(cur == nullptr)
+			{
+				found = (lower != nullptr && !Tree.Less(key, lower->Key)) ? lower : nullptr;
+				return true;
+			}
+
+			if(!Tree.Less(cur->Key, key))
+			{
+				lower = cur;
+				cur = cur->Left.load(std::memory_order_acquire);
+			}
+			else
+				cur = cur->isThreaded.load(std::memory_order_acquire) ? nullptr : cur->Right.load(std::memory_order_acquire);
+		}
+		return false;
+	}
+
+	/* scanRange()
+	 *
+	 * collects the keys in [lower..upper] into keys. Without the lock it
+	 * rechecks Version as it goes, returning false as soon as a write
+	 * shows up.
+	 */
+
+	bool scanRange(const KeyT& lower, const KeyT& upper, vector<KeyT>& keys,
+	               unsigned long version, bool locked) const
+	{
+		keys.clear();
+
+		// smallest node >= lower, like avlt::lower_bound
+		const NODE* cur = Tree.ogRoot.load(std::memory_order_acquire);
+		const NODE* node = nullptr;
+		for(int steps = 0; cur != nullptr; steps++)
+		{
+			if(steps == tree_type::MaxPath)
+				return false;
+
+			if(!Tree.Less(cur->Key, lower))
+			{
+				node = cur;
+				cur = cur->Left.load(std::memory_order_acquire);
+			}
+			else
+				cur = cur->isThreaded.load(std::memory_order_acquire) ? nullptr : cur->Right.load(std::memory_order_acquire);
+		}
+
+		int visited = 0;
+		while(node != nullptr && !Tree.Less(upper, node->Key))
+		{
+			keys.push_back(node->Key);
+
+			// successor, with the walk down the right subtree bounded too
+			if(node->isThreaded.load(std::memory_order_acquire))
+				node = node->Right.load(std::memory_order_acquire);
+			else if((node = node->Right.load(std::memory_order_acquire)) != nullptr)
+			{
+				for(int steps = 0; node->Left.load(std::memory_order_acquire) != nullptr; steps++)
+				{
+					if(steps == tree_type::MaxPath)
+						return false;
+					node = node->Left.load(std::memory_order_acquire);
+				}
+			}
+
+			if(!locked && ++visited % RangeCheckEvery == 0 && !readValid(version))
+				return false;
+		}
+		return true;
+	}
+
+public:
+
+  //
+  // default constructor:
+  //
+  // Creates an empty tree.
+  //
+  concurrent_avlt()
+    : Version(0)
+  {
+    clearReaders();
+  }
+
+  //
+  // allocator constructor:
+  //
+  // Creates an empty tree whose nodes come from the given allocator.
+  //
+  explicit concurrent_avlt(const Alloc& alloc)
+    : Version(0), Tree(alloc)
+  {
+    clearReaders();
+  }
+
+  //
+  // comparator constructor:
+  //
+  // Creates an empty tree ordered by the given comparator.
+  //
+  explicit concurrent_avlt(const Compare& comp, const Alloc& alloc = Alloc())
+    : Version(0), Tree(comp, alloc)
+  {
+    clearReaders();
+  }
+
+  //
+  // destructor:
+  //
+  // Gives the erased nodes still held for readers back to the pool.
+  //
+  ~concurrent_avlt()
+  {
+    reclaim(true);
+  }
+
+  concurrent_avlt(const concurrent_avlt&) = delete;
+  concurrent_avlt& operator=(const concurrent_avlt&) = delete;
+
+  //
+  // size:
+  //
+  // Returns the # of nodes in the tree, 0 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int size() const
+  {
+    std::lock_guard<std::mutex> lock(WriteLock);
+    return Tree.size();
+  }
+
+  //
+  // search:
+  //
+  // Searches the tree for the given key, returning true if found
+  // and false if not.  If the key is found, the corresponding value
+  // is returned via the reference parameter. Never blocks unless writes
+  // keep overlapping it.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    for(int tries = 0; tries < OptimisticTries; tries++)
+    {
+      ReadGuard guard(*this);
+
+			const NODE* node;
+			if(!findNode(key, node))
+				continue;
+
+			ValueT copy = (node != nullptr) ? node->Value : ValueT{};
+			if(!readValid(guard.Start))
+				continue;
+
+			if(node == nullptr)
+				return false;
+			value = copy;
+			return true;
+    }
+
+		std::lock_guard<std::mutex> lock(WriteLock);
+		return Tree.search(key, value);
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    ValueT value{};
+		search(key, value);
+		return value;
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive, as one
+  // consistent view of the tree.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+
+    for(int tries = 0; tries < OptimisticTries; tries++)
+    {
+      ReadGuard guard(*this);
+			if(scanRange(lower, upper, keys, guard.Start, false) && readValid(guard.Start))
+				return keys;
+    }
+
+		std::lock_guard<std::mutex> lock(WriteLock);
+		scanRange(lower, upper, keys, 0, true);
+		return keys;
+  }
+
+  //
+  // insert
+  //
+  // Same as avlt::insert; waits for other writers.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  void insert(const KeyT& key, const ValueT& value)
+  {
+    WriteGuard guard(*this);
+		Tree.insert(key, value);
+		reclaim(false);
+  }
+
+  //
+  // insert_batch
+  //
+  // Same as avlt::insert_batch; the whole batch is one write.
+  //
+  void insert_batch(vector<pair<KeyT, ValueT>> batch)
+  {
+    WriteGuard guard(*this);
+		Tree.insert_batch(std::move(batch));
+		reclaim(false);
+  }
+
+  //
+  // erase
+  //
+  // Same as avlt::erase; waits for other writers. The node goes back to
+  // the pool once no reader can be looking at it, see reclaim().
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool erase(const KeyT& key)
+  {
+    WriteGuard guard(*this);
+		NODE* node = Tree.unlinkNode(key);
+		if(node == nullptr)
+			return false;
+
+		Retired.push_back(node);
+		reclaim(false);
+		return true;
+  }
+
+  //
+  // clear:
+  //
+  // Empties the tree, once the lock-free reads in progress are done.
+  // The slabs are kept for reuse rather than freed.
+  //
+  void clear()
+  {
+    WriteGuard guard(*this);
+		reclaim(true);
+		Tree.Pool.recycle();
+		Tree.statFree(Tree.Size);
+		Tree.Root = nullptr;
+		Tree.ogRoot = nullptr;
+		Tree.Cursor = nullptr;
+		Tree.Size = 0;
+  }
+};
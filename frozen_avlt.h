@@ -0,0 +1,199 @@
+/*frozen_avlt.h*/
+
+//
+// Read-only snapshot of an avlt, laid out for fast searching
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// same as in avlt.h, for when this header is used on its own
+#ifndef AVLT_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define AVLT_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define AVLT_PREFETCH(p) ((void)0)
+#endif
+#endif
+
+//
+// frozen_avlt holds the contents of an avlt (see avlt::freeze) in flat
+// arrays that never change again, for phases where the data is only read.
+//
+// Searches run over a copy of the keys in Eytzinger order: the implicit
+// perfectly balanced tree where the children of slot k are slots 2k and
+// 2k+1. A descent never branches on the comparison, it only computes the
+// next slot from it, so there are no mispredicted branches, and the
+// descendants a few levels down share cache lines, so they are prefetched
+// well before they are needed. For each slot, Rank gives the key's place
+// in the sorted Keys/Values arrays, where range scans read straight
+// through memory. Compare orders the keys, as for avlt.
+//
+template<typename KeyT, typename ValueT, typename Compare = std::less<KeyT>>
+class frozen_avlt
+{
+private:
+  vector<KeyT>     Eytz;    // keys in Eytzinger order, from slot 1 (slot 0 unused)
+  vector<uint32_t> Rank;    // Rank[k] = index of Eytz[k] in Keys/Values
+  vector<KeyT>     Keys;    // keys in order
+  vector<ValueT>   Values;  // Values[i] goes with Keys[i]
+  Compare          Less;    // orders the keys
+
+  // slots in one cache line; prefetching slot k * PrefetchAhead reaches
+  // the descendants of k that many levels down in one go
+  static const size_t PrefetchAhead = (64 / sizeof(KeyT)) > 1 ? (64 / sizeof(KeyT)) : 2;
+
+	/* fill()
+	 *
+	 * walks the implicit tree in order, handing out the sorted keys, so
+	 * the slots end up in Eytzinger order
+	 */
+
+	void fill(size_t k, size_t& i)
+	{
+		if(k >= Eytz.size())
+			return;
+
+		fill(2 * k, i);
+		Eytz[k] = Keys[i];
+		Rank[k] = (uint32_t) i;
+		i++;
+		fill(2 * k + 1, i);
+	}
+
+	/* lowerSlot()
+	 *
+	 * slot of the smallest key >= key, or 0 if every key is smaller. The
+	 * descent goes left or right by adding the comparison to 2k; once it
+	 * falls off the bottom, the last slot where it went left is found by
+	 * dropping the trailing right turns (1 bits) and that left turn.
+	 */
+
+	size_t lowerSlot(const KeyT& key) const
+	{
+		size_t n = Eytz.size();
+		size_t k = 1;
+
+		while(k < n)
+		{
+			size_t ahead = k * PrefetchAhead;
+			if(ahead < n)
+				AVLT_PREFETCH(&Eytz[ahead]);
+			k = 2 * k + (size_t) Less(Eytz[k], key);
+		}
+
+#if defined(__GNUC__) || defined(__clang__)
+		k >>= __builtin_ffsll((long long) ~k);
+#else
+		while(k & 1)
+			k >>= 1;
+		k >>= 1;
+#endif
+		return k;
+	}
+
+public:
+
+  //
+  // constructor:
+  //
+  // Takes the keys in strictly increasing order and their values; see
+  // avlt::freeze. An empty snapshot is made by default.
+  //
+  frozen_avlt(vector<KeyT> keys = vector<KeyT>(), vector<ValueT> values = vector<ValueT>(),
+              const Compare& comp = Compare())
+    : Keys(std::move(keys)), Values(std::move(values)), Less(comp)
+  {
+    Eytz.resize(Keys.size() + 1);
+    Rank.resize(Keys.size() + 1);
+
+    size_t i = 0;
+    fill(1, i);
+  }
+
+  //
+  // size:
+  //
+  // Returns the # of keys, 0 if empty.
+  //
+  int size() const
+  {
+    return (int) Keys.size();
+  }
+
+  //
+  // memory_usage:
+  //
+  // Returns the bytes the snapshot holds.
+  //
+  size_t memory_usage() const
+  {
+    return sizeof(*this) + Eytz.capacity() * sizeof(KeyT) + Rank.capacity() * sizeof(uint32_t) +
+           Keys.capacity() * sizeof(KeyT) + Values.capacity() * sizeof(ValueT);
+  }
+
+  //
+  // search:
+  //
+  // Searches for the given key, returning true if found and false if
+  // not.  If the key is found, the corresponding value is returned via
+  // the reference parameter.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    size_t k = lowerSlot(key);
+    if(k == 0 || Less(key, Eytz[k]))
+      return false;
+
+    value = Values[Rank[k]];
+    return true;
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    size_t k = lowerSlot(key);
+    if(k == 0 || Less(key, Eytz[k]))
+      return ValueT{};
+
+    return Values[Rank[k]];
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+
+    size_t k = lowerSlot(lower);
+    if(k == 0)
+      return keys;
+
+    size_t last = Rank[k];
+    while(last < Keys.size() && !Less(upper, Keys[last]))
+      last++;
+
+    keys.assign(Keys.begin() + Rank[k], Keys.begin() + last);
+    return keys;
+  }
+};
@@ -0,0 +1,647 @@
+/*mapped_avlt.h*/
+
+//
+// Read-only avlt served straight from a file written by avlt::save()
+//
+// Include this header to use avlt::save() and avlt::load(); avlt.h
+// itself doesn't, since the mapping needs the POSIX headers below.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "avlt.h"
+
+//
+// mapped_avlt maps a snapshot file (see avlt::save and avlt::load) into
+// memory and searches it where it lies, so a process can serve reads as
+// soon as the file is open instead of inserting every key again. Opening
+// reads through the records once to check them, so a corrupt file is
+// turned away up front rather than sending a lookup out of bounds.
+//
+// The file holds the tree's nodes as fixed-size records in key order,
+// with the children given as record indices instead of pointers, so it
+// means the same wherever it is mapped:
+//
+//   header   64 bytes: "AVLTSNAP", format version, byte order check,
+//            sizeof KeyT / ValueT / record, # of records, root, height
+//   records  { KeyT Key; ValueT Value; int32_t Left; int32_t Right; }
+//            for every node in order, -1 for a missing child
+//
+// Since the records are in key order, the in-order successor of record i
+// is record i+1, so no threads are stored and range scans read straight
+// through the file. KeyT and ValueT must be trivially copyable, and a
+// file is only read back by a program built with the same KeyT, ValueT
+// and Compare on a machine with the same byte order; the sizes and byte
+// order are checked when the file is opened, the types themselves can't
+// be. materialize() copies the contents back into a mutable avlt.
+//
+template<typename KeyT, typename ValueT, typename Compare = std::less<KeyT>>
+class mapped_avlt
+{
+private:
+  static_assert(std::is_trivially_copyable<KeyT>::value &&
+                std::is_trivially_copyable<ValueT>::value,
+                "snapshot files hold keys and values as raw bytes");
+
+  struct Header
+  {
+    char     Magic[8];     // "AVLTSNAP"
+    uint32_t Version;      // FormatVersion
+    uint32_t ByteOrder;    // ByteOrderMark as the writer saw it
+    uint32_t KeySize;
+    uint32_t ValueSize;
+    uint32_t RecordSize;
+    int32_t  Root;         // index of the root record, -1 if empty
+    uint64_t Count;        // # of records
+    int32_t  Height;       // height of the tree, -1 if empty
+    unsigned char Unused[20];
+  };
+
+  struct Record
+  {
+    KeyT    Key;
+    ValueT  Value;
+    int32_t Left;   // index of the left child, -1 if none
+    int32_t Right;  // index of the right child, -1 if none
+  };
+
+  static const uint32_t FormatVersion = 1;
+  static const uint32_t ByteOrderMark = 0x01020304;
+  static const int32_t  MaxHeight = 64;  // more than any AVL tree of INT32_MAX nodes
+  static const size_t   BufferRecords = 1 << 16;  // records save() holds before writing them out
+
+  static_assert(sizeof(Header) == 64, "the records start 64 bytes into the file");
+  static_assert(alignof(Record) <= 64, "records must stay aligned in a mapped file");
+
+  void*         Map;      // the whole file, nullptr if none is open
+  size_t        MapSize;
+  const Record* Records;  // Count records, in key order
+  size_t        Count;
+  int32_t       Root;
+  int32_t       Height;
+  Compare       Less;     // orders the keys, as for avlt
+
+	/* lowerIndex()
+	 *
+	 * index of the first record whose key is >= key, or -1 if every key
+	 * is smaller. One comparison per level, as in avlt::lowerNode().
+	 */
+
+	int32_t lowerIndex(const KeyT& key) const
+	{
+		int32_t cur = Root;
+		int32_t found = -1;
+		while(cur >= 0)
+		{
+			const Record& r = Records[cur];
+			if(!Less(r.Key, key))
+			{
+				found = cur;
+				cur = r.Left;
+			}
+			else
+				cur = r.Right;
+		}
+		return found;
+	}
+
+	/* findRecord()
+	 *
+	 * key's record, or nullptr if key isn't in the file
+	 */
+
+	const Record* findRecord(const KeyT& key) const
+	{
+		int32_t i = lowerIndex(key);
+		if(i < 0 || Less(key, Records[i].Key))
+			return nullptr;
+		return &Records[i];
+	}
+
+	/* RecordWriter
+	 *
+	 * streams records to a snapshot file, after its header, through a
+	 * buffer of BufferRecords, so saving never holds more than that in
+	 * memory. setRight() fills in a record's right child once it is
+	 * known: in the buffer if the record is still there, else in the file.
+	 */
+
+	class RecordWriter
+	{
+	public:
+		explicit RecordWriter(FILE* out)
+			: Out(out), Written(0), Ok(true)
+		{
+			Buffer.reserve(BufferRecords);
+		}
+
+		// index the record will have in the file
+		int32_t append(const Record& r)
+		{
+			if(Buffer.size() == BufferRecords)
+				flush();
+			Buffer.push_back(r);
+			return (int32_t) (Written + Buffer.size() - 1);
+		}
+
+		void setRight(int32_t index, int32_t right)
+		{
+			if((size_t) index >= Written)
+			{
+				Buffer[index - Written].Right = right;
+				return;
+			}
+
+			Record r;  // just for where Right sits in a record
+			off_t at = (off_t) (sizeof(Header) + (size_t) index * sizeof(Record) +
+			                    ((const char*) &r.Right - (const char*) &r));
+			Ok = Ok && fseeko(Out, at, SEEK_SET) == 0 &&
+			     fwrite(&right, sizeof(right), 1, Out) == 1 &&
+			     fseeko(Out, 0, SEEK_END) == 0;
+		}
+
+		// writes out the buffer; false if any write so far failed
+		bool flush()
+		{
+			if(!Buffer.empty())
+				Ok = Ok && fwrite(Buffer.data(), sizeof(Record), Buffer.size(), Out) == Buffer.size();
+			Written += Buffer.size();
+			Buffer.clear();
+			return Ok;
+		}
+
+		size_t count() const
+		{
+			return Written + Buffer.size();
+		}
+
+	private:
+		FILE*          Out;
+		vector<Record> Buffer;   // the records after the first Written
+		size_t         Written;  // # of records already in the file
+		bool           Ok;
+	};
+
+	/* writeRecords()
+	 *
+	 * writes the subtree under node to out in order, each record with its
+	 * children's indices, and returns the index of node's record (-1 for
+	 * an empty subtree). A record's right child is only known once the
+	 * right subtree is written, so it is filled in afterwards.
+	 */
+
+	template<typename Tree>
+	static int32_t writeRecords(const typename Tree::NODE* node, RecordWriter& out)
+	{
+		if(node == nullptr)
+			return -1;
+
+		int32_t left = writeRecords<Tree>(node->Left, out);
+
+		Record r;
+		memset(&r, 0, sizeof(r));  // no stray bytes from the padding end up in the file
+		r.Key = node->Key;
+		r.Value = node->Value;
+		r.Left = left;
+		r.Right = -1;
+
+		int32_t index = out.append(r);
+
+		if(!node->isThreaded)
+		{
+			int32_t right = writeRecords<Tree>(node->Right, out);
+			if(right >= 0)
+				out.setRight(index, right);
+		}
+		return index;
+	}
+
+	/* buildNodes()
+	 *
+	 * helper function for materialize. Rebuilds the subtree under record
+	 * index as nodes of tree, in order and in the same shape, threading
+	 * each node that has no right child to the next one built, the way
+	 * avlt::buildBalanced() does.
+	 */
+
+	template<typename Tree>
+	typename Tree::NODE* buildNodes(Tree& tree, int32_t index, typename Tree::NODE*& pending) const
+	{
+		typedef typename Tree::NODE NODE;
+
+		if(index < 0)
+			return nullptr;
+
+		const Record& r = Records[index];
+		NODE* left = buildNodes(tree, r.Left, pending);
+		NODE* node = tree.createNode(r.Key, r.Value);
+
+		if(pending != nullptr)
+		{
+			pending->Right = node;
+			pending->isThreaded = true;
+		}
+		pending = nullptr;
+
+		node->Left = left;
+		node->Right = buildNodes(tree, r.Right, pending);
+		if(node->Right == nullptr)
+			pending = node;
+
+		node->Height = 1 + max(tree.assignHeight(node->Left), tree.assignHeight(node->Right));
+		Tree::assignCount(node);
+		return node;
+	}
+
+	/* valid()
+	 *
+	 * checks that a header describes this KeyT / ValueT, and a file of
+	 * fileSize bytes
+	 */
+
+	static bool valid(const Header& h, size_t fileSize)
+	{
+		return memcmp(h.Magic, "AVLTSNAP", 8) == 0 &&
+		       h.Version == FormatVersion &&
+		       h.ByteOrder == ByteOrderMark &&
+		       h.KeySize == sizeof(KeyT) &&
+		       h.ValueSize == sizeof(ValueT) &&
+		       h.RecordSize == sizeof(Record) &&
+		       h.Count <= (uint64_t) INT32_MAX &&
+		       fileSize == sizeof(Header) + h.Count * sizeof(Record) &&
+		       h.Root >= -1 && (int64_t) h.Root < (int64_t) h.Count &&
+		       (h.Root >= 0) == (h.Count > 0) &&
+		       h.Height >= -1 && h.Height < MaxHeight &&
+		       (h.Height >= 0) == (h.Count > 0);
+	}
+
+	/* validRecords()
+	 *
+	 * checks that the records are one binary search tree over all count
+	 * of them, the way save() writes it: walked in order from root, the
+	 * records come up as 0, 1, 2, ... with their keys ascending, every
+	 * child index is -1 or a record, and no record lies deeper than the
+	 * saved height. A cycle, a shared or out-of-range child, or keys out
+	 * of order make the walk fail; it keeps its own stack, bounded by the
+	 * height, so a bad file can't run it out of stack or loop forever.
+	 */
+
+	bool validRecords(const Record* records, size_t count, int32_t root, int32_t height) const
+	{
+		struct Step { int32_t Index; int32_t Depth; };
+		Step stack[MaxHeight];
+		int top = 0;
+
+		size_t next = 0;  // the record the walk should come to next
+		int32_t cur = root;
+		int32_t depth = 0;
+		for(;;)
+		{
+			while(cur != -1)  // down the left side, stacking the records
+			{
+				if(cur < 0 || (size_t) cur >= count || depth > height)
+					return false;
+				stack[top].Index = cur;
+				stack[top].Depth = depth;
+				top++;
+				cur = records[cur].Left;
+				depth++;
+			}
+
+			if(top == 0)
+				return next == count;
+
+			top--;
+			if((size_t) stack[top].Index != next)
+				return false;
+			if(next > 0 && !Less(records[next - 1].Key, records[next].Key))
+				return false;
+			next++;
+
+			cur = records[stack[top].Index].Right;
+			depth = stack[top].Depth + 1;
+		}
+	}
+
+public:
+
+  //
+  // default constructor:
+  //
+  // Creates a mapped_avlt with no file open, which acts as an empty tree.
+  //
+  explicit mapped_avlt(const Compare& comp = Compare())
+    : Map(nullptr), MapSize(0), Records(nullptr), Count(0), Root(-1), Height(-1), Less(comp)
+  { }
+
+  //
+  // constructor:
+  //
+  // Opens the snapshot file at path, see open().
+  //
+  explicit mapped_avlt(const string& path, const Compare& comp = Compare())
+    : mapped_avlt(comp)
+  {
+    open(path);
+  }
+
+  mapped_avlt(const mapped_avlt&) = delete;
+  mapped_avlt& operator=(const mapped_avlt&) = delete;
+
+  //
+  // move constructor / move assignment:
+  //
+  // Takes over other's mapping; other is left with no file open.
+  //
+  mapped_avlt(mapped_avlt&& other) noexcept
+    : Map(other.Map), MapSize(other.MapSize), Records(other.Records), Count(other.Count),
+      Root(other.Root), Height(other.Height), Less(std::move(other.Less))
+  {
+    other.Map = nullptr;
+    other.MapSize = 0;
+    other.Records = nullptr;
+    other.Count = 0;
+    other.Root = -1;
+    other.Height = -1;
+  }
+
+  mapped_avlt& operator=(mapped_avlt&& other) noexcept
+  {
+    if(this != &other)
+    {
+      close();
+      std::swap(Map, other.Map);
+      std::swap(MapSize, other.MapSize);
+      std::swap(Records, other.Records);
+      std::swap(Count, other.Count);
+      std::swap(Root, other.Root);
+      std::swap(Height, other.Height);
+      Less = std::move(other.Less);
+    }
+    return *this;
+  }
+
+  //
+  // destructor:
+  //
+  // Unmaps the file, if one is open.
+  //
+  ~mapped_avlt()
+  {
+    close();
+  }
+
+  //
+  // open
+  //
+  // Closes the current file, if any, and maps the snapshot file at path
+  // read-only. Returns false if the file can't be opened or mapped,
+  // wasn't written by save() for this KeyT and ValueT, or is damaged:
+  // every record's links and key order are checked, see validRecords().
+  // The mapped_avlt is then empty.
+  //
+  // Time complexity:  O(N)
+  //
+  bool open(const string& path)
+  {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+      return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    size_t size = (size_t) st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // the mapping keeps the file open
+    if(map == MAP_FAILED)
+      return false;
+
+    const Header& h = *static_cast<const Header*>(map);
+    const Record* records = reinterpret_cast<const Record*>(static_cast<const unsigned char*>(map) + sizeof(Header));
+    if(!valid(h, size) || !validRecords(records, (size_t) h.Count, h.Root, h.Height))
+    {
+      munmap(map, size);
+      return false;
+    }
+
+    Map = map;
+    MapSize = size;
+    Records = records;
+    Count = (size_t) h.Count;
+    Root = h.Root;
+    Height = h.Height;
+    return true;
+  }
+
+  //
+  // close
+  //
+  // Unmaps the file; the mapped_avlt is empty afterwards.
+  //
+  void close()
+  {
+    if(Map != nullptr)
+      munmap(Map, MapSize);
+
+    Map = nullptr;
+    MapSize = 0;
+    Records = nullptr;
+    Count = 0;
+    Root = -1;
+    Height = -1;
+  }
+
+  //
+  // is_open
+  //
+  // Returns true if a snapshot file is mapped.
+  //
+  bool is_open() const
+  {
+    return Map != nullptr;
+  }
+
+  //
+  // size:
+  //
+  // Returns the # of keys, 0 if empty.
+  //
+  int size() const
+  {
+    return (int) Count;
+  }
+
+  //
+  // height:
+  //
+  // Returns the height of the saved tree, -1 if empty.
+  //
+  int height() const
+  {
+    return Height;
+  }
+
+  //
+  // search:
+  //
+  // Searches for the given key, returning true if found and false if
+  // not.  If the key is found, the corresponding value is returned via
+  // the reference parameter.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    const Record* r = findRecord(key);
+    if(r == nullptr)
+      return false;
+
+    value = r->Value;
+    return true;
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    const Record* r = findRecord(key);
+    return (r == nullptr) ? ValueT{} : r->Value;
+  }
+
+  //
+  // find_value
+  //
+  // Returns a pointer to key's value inside the mapping, or nullptr if
+  // key isn't there. It stays valid until the file is closed.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  const ValueT* find_value(const KeyT& key) const
+  {
+    const Record* r = findRecord(key);
+    return (r == nullptr) ? nullptr : &r->Value;
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+
+    int32_t i = lowerIndex(lower);
+    if(i < 0)
+      return keys;
+
+    for(size_t j = (size_t) i; j < Count && !Less(upper, Records[j].Key); j++)
+      keys.push_back(Records[j].Key);
+    return keys;
+  }
+
+  //
+  // materialize
+  //
+  // Returns a mutable avlt with the file's contents, in the same shape
+  // the tree had when it was saved. Nothing is searched or rotated, the
+  // nodes are just built in order.
+  //
+  // Time complexity:  O(N)
+  //
+  template<typename Alloc = std::allocator<std::pair<const KeyT, ValueT>>>
+  avlt<KeyT, ValueT, Compare, Alloc> materialize(const Alloc& alloc = Alloc()) const
+  {
+    typedef avlt<KeyT, ValueT, Compare, Alloc> tree_type;
+
+    tree_type tree(Less, alloc);
+    typename tree_type::NODE* pending = nullptr;
+    tree.Root = buildNodes(tree, Root, pending);
+    tree.ogRoot = tree.Root;
+    tree.Size = (int) Count;
+    return tree;
+  }
+
+  //
+  // save
+  //
+  // Writes tree to path in the snapshot format; see avlt::save, which
+  // calls this. The file is written next to path and renamed over it
+  // once complete, so a reader never maps a half-written snapshot. The
+  // records are streamed out as the tree is walked, so only a fixed
+  // buffer of them is held in memory. Returns false if the file couldn't
+  // be written.
+  //
+  // Time complexity:  O(N)
+  //
+  template<typename Alloc>
+  static bool save(const avlt<KeyT, ValueT, Compare, Alloc>& tree, const string& path)
+  {
+    typedef avlt<KeyT, ValueT, Compare, Alloc> tree_type;
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.Magic, "AVLTSNAP", 8);
+    h.Version = FormatVersion;
+    h.ByteOrder = ByteOrderMark;
+    h.KeySize = sizeof(KeyT);
+    h.ValueSize = sizeof(ValueT);
+    h.RecordSize = sizeof(Record);
+    h.Root = -1;
+    h.Count = 0;
+    h.Height = tree.height();
+
+    string temp = path + ".tmp";
+    FILE* out = fopen(temp.c_str(), "wb");
+    if(out == nullptr)
+      return false;
+
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+    if(ok)
+    {
+      RecordWriter writer(out);
+      h.Root = writeRecords<tree_type>(tree.ogRoot, writer);
+      h.Count = writer.count();
+      ok = writer.flush();
+
+      // the root and count are only known now
+      ok = ok && fseeko(out, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, out) == 1;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if(!ok || rename(temp.c_str(), path.c_str()) != 0)
+    {
+      remove(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+};
@@ -0,0 +1,476 @@
+/*persistent_avlt.h*/
+
+//
+// Persistent (copy-on-write) AVL tree with O(1) snapshots
+//
+
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#include "avlt.h"
+
+//
+// persistent_avlt is an AVL tree whose nodes are shared between versions.
+// snapshot() (or copying the tree) just takes another reference to the
+// root, so it is O(1). When a version is changed, every node on the path
+// from the root down to the change that is still shared with some other
+// version is copied first, and the copy is changed instead; nodes that
+// only this version uses are changed in place. Each version therefore
+// keeps seeing exactly what it saw when it was taken.
+//
+// Nodes are reference counted, so an old version's nodes are freed when
+// the last snapshot still using them goes away, on whichever thread that
+// happens. Snapshots can be handed to other threads and read there while
+// the original keeps being changed; a single version must still not be
+// changed and read at the same time.
+//
+// Unlike avlt, there are no right-threads: a thread points into another
+// part of the tree, so one change would force copying nodes far off the
+// changed path. Scans use a small stack of ancestors instead.
+//
+template<typename KeyT, typename ValueT>
+class persistent_avlt
+{
+private:
+  struct NODE
+  {
+    KeyT   Key;
+    ValueT Value;
+    NODE*  Left;
+    NODE*  Right;
+    int    Height;  // height of tree rooted at this node
+    std::atomic<int> Refs;  // # of parents and versions pointing here
+
+    NODE(const KeyT& key, const ValueT& value, NODE* left, NODE* right, int height)
+      : Key(key), Value(value), Left(left), Right(right), Height(height), Refs(1)
+    { }
+  };
+
+  NODE* Root;  // pointer to root node of tree (nullptr if empty)
+  int   Size;  // # of nodes in the tree (0 if empty)
+
+	/* retain() / release()
+	 *
+	 * take and drop a reference to a node. Dropping the last reference
+	 * frees the node and drops its references to its children.
+	 */
+
+	static NODE* retain(NODE* node)
+	{
+		if(node != nullptr)
+			node->Refs.fetch_add(1, std::memory_order_relaxed);
+		return node;
+	}
+
+	static void release(NODE* node)
+	{
+		while(node != nullptr && node->Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			release(node->Left);
+			NODE* right = node->Right;
+			delete node;
+			node = right;
+		}
+	}
+
+	/* own()
+	 *
+	 * Takes over one reference to node and returns a node this version
+	 * may change: node itself if nobody else uses it, otherwise a copy
+	 * (which shares node's children). Called top-down along a path, so a
+	 * node is never reached through a shared parent that wasn't copied.
+	 */
+
+	static NODE* own(NODE* node)
+	{
+		if(node->Refs.load(std::memory_order_acquire) == 1)
+			return node;
+
+		NODE* copy = new NODE(node->Key, node->Value, retain(node->Left), retain(node->Right), node->Height);
+		release(node);
+		return copy;
+	}
+
+	static int height(const NODE* node)
+	{
+		return (node == nullptr) ? -1 : node->Height;
+	}
+
+	static void fixHeight(NODE* node)
+	{
+		node->Height = 1 + std::max(height(node->Left), height(node->Right));
+	}
+
+	/* rotateRight() / rotateLeft()
+	 *
+	 * the usual AVL rotations on an owned node, returning the new top of
+	 * the subtree. The child that moves up is made owned first.
+	 */
+
+	static NODE* rotateRight(NODE* cur)
+	{
+		NODE* cl = own(cur->Left);
+		cur->Left = cl->Right;
+		cl->Right = cur;
+		fixHeight(cur);
+		fixHeight(cl);
+		return cl;
+	}
+
+	static NODE* rotateLeft(NODE* cur)
+	{
+		NODE* cr = own(cur->Right);
+		cur->Right = cr->Left;
+		cr->Left = cur;
+		fixHeight(cur);
+		fixHeight(cr);
+		return cr;
+	}
+
+	/* rebalance()
+	 *
+	 * fixes the height of an owned node whose subtrees just changed, and
+	 * rotates if one side got more than 1 taller than the other
+	 */
+
+	static NODE* rebalance(NODE* cur)
+	{
+		fixHeight(cur);
+		int balance = height(cur->Left) - height(cur->Right);
+
+		if(balance >= 2)
+		{
+			if(height(cur->Left->Left) < height(cur->Left->Right))  //Left Right Rotate
+				cur->Left = rotateLeft(own(cur->Left));
+			return rotateRight(cur);
+		}
+		if(balance <= -2)
+		{
+			if(height(cur->Right->Right) < height(cur->Right->Left))  //Right Left Rotate
+				cur->Right = rotateRight(own(cur->Right));
+			return rotateLeft(cur);
+		}
+		return cur;
+	}
+
+	/* insertPath()
+	 *
+	 * inserts a key that is known not to be in the subtree, copying the
+	 * shared nodes along the way. Takes over the reference to node and
+	 * returns the new subtree.
+	 */
+
+	static NODE* insertPath(NODE* node, const KeyT& key, const ValueT& value)
+	{
+		if(node == nullptr)
+			return new NODE(key, value, nullptr, nullptr, 0);
+
+		node = own(node);
+		if(key < node->Key)
+			node->Left = insertPath(node->Left, key, value);
+		else
+			node->Right = insertPath(node->Right, key, value);
+		return rebalance(node);
+	}
+
+	/* erasePath()
+	 *
+	 * removes a key that is known to be in the subtree, the same way as
+	 * insertPath(). A node with two children takes over the key and value
+	 * of the smallest node on its right, which is then removed instead.
+	 */
+
+	static NODE* erasePath(NODE* node, const KeyT& key)
+	{
+		node = own(node);
+
+		if(key < node->Key)
+			node->Left = erasePath(node->Left, key);
+		else if(node->Key < key)
+			node->Right = erasePath(node->Right, key);
+		else if(node->Left != nullptr && node->Right != nullptr)
+		{
+			const NODE* next = node->Right;
+			while(next->Left != nullptr)
+				next = next->Left;
+
+			node->Key = next->Key;
+			node->Value = next->Value;
+			node->Right = erasePath(node->Right, node->Key);
+		}
+		else
+		{
+			NODE* child = retain(node->Left != nullptr ? node->Left : node->Right);
+			release(node);
+			return child;
+		}
+
+		return rebalance(node);
+	}
+
+	const NODE* findNode(const KeyT& key) const
+	{
+		const NODE* cur = Root;
+		while(cur != nullptr)
+		{
+			if(key == cur->Key)
+				return cur;
+			cur = (key < cur->Key) ? cur->Left : cur->Right;
+		}
+		return nullptr;
+	}
+
+	/* buildBalanced()
+	 *
+	 * builds a perfectly balanced subtree out of the next count pairs of
+	 * an avlt scan, which are already in key order
+	 */
+
+	template<typename It>
+	static NODE* buildBalanced(It& it, size_t count)
+	{
+		if(count == 0)
+			return nullptr;
+
+		size_t leftCount = count / 2;
+		NODE* left = buildBalanced(it, leftCount);
+		NODE* node = new NODE(it.key(), it.value(), left, nullptr, 0);
+		++it;
+		node->Right = buildBalanced(it, count - leftCount - 1);
+		fixHeight(node);
+		return node;
+	}
+
+public:
+
+  //
+  // default constructor:
+  //
+  // Creates an empty tree.
+  //
+  persistent_avlt()
+  {
+    Root = nullptr;
+    Size = 0;
+  }
+
+  //
+  // avlt constructor:
+  //
+  // Creates a persistent copy of the contents of an avlt, built balanced
+  // straight from its in-order scan. The avlt has to be ordered by <,
+  // like this tree.
+  //
+  // Time complexity:  O(N)
+  //
+  template<typename Alloc>
+  explicit persistent_avlt(const avlt<KeyT, ValueT, std::less<KeyT>, Alloc>& tree)
+  {
+    typename avlt<KeyT, ValueT, std::less<KeyT>, Alloc>::const_iterator it = tree.cbegin();
+    Root = buildBalanced(it, tree.size());
+    Size = tree.size();
+  }
+
+  //
+  // copy constructor
+  //
+  // Shares every node with the "other" tree; see snapshot().
+  //
+  // Time complexity:  O(1)
+  //
+  persistent_avlt(const persistent_avlt& other)
+  {
+    Root = retain(other.Root);
+    Size = other.Size;
+  }
+
+  persistent_avlt(persistent_avlt&& other) noexcept
+  {
+    Root = other.Root;
+    Size = other.Size;
+    other.Root = nullptr;
+    other.Size = 0;
+  }
+
+  //
+  // destructor:
+  //
+  // Drops this version's reference to the nodes; nodes no other version
+  // uses are freed.
+  //
+  ~persistent_avlt()
+  {
+    release(Root);
+  }
+
+  persistent_avlt& operator=(persistent_avlt other) noexcept
+  {
+    std::swap(Root, other.Root);
+    std::swap(Size, other.Size);
+    return *this;
+  }
+
+  //
+  // snapshot:
+  //
+  // Returns a read-only version of the tree as it is right now. Later
+  // changes to this tree don't show up in it, and it stays valid however
+  // long it is kept.
+  //
+  // Time complexity:  O(1)
+  //
+  const persistent_avlt snapshot() const
+  {
+    return persistent_avlt(*this);
+  }
+
+  //
+  // clear:
+  //
+  // Empties this version; snapshots keep their nodes.
+  //
+  void clear()
+  {
+    release(Root);
+    Root = nullptr;
+    Size = 0;
+  }
+
+  //
+  // size:
+  //
+  // Returns the # of nodes in the tree, 0 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int size() const
+  {
+    return Size;
+  }
+
+  //
+  // height:
+  //
+  // Returns the height of the tree, -1 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int height() const
+  {
+    return height(Root);
+  }
+
+  //
+  // search:
+  //
+  // Searches the tree for the given key, returning true if found
+  // and false if not.  If the key is found, the corresponding value
+  // is returned via the reference parameter.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    const NODE* node = findNode(key);
+    if(node == nullptr)
+      return false;
+
+    value = node->Value;
+    return true;
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    const NODE* node = findNode(key);
+    return (node == nullptr) ? ValueT{} : node->Value;
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive, in order.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+    vector<const NODE*> stack;  // ancestors still to be visited, smallest on top
+
+    const NODE* cur = Root;
+    while(cur != nullptr || !stack.empty())
+    {
+      // go down to the smallest node >= lower, remembering the way back up
+      while(cur != nullptr)
+      {
+        if(cur->Key < lower)
+          cur = cur->Right;
+        else
+        {
+          stack.push_back(cur);
+          cur = cur->Left;
+        }
+      }
+
+      if(stack.empty())
+        break;
+
+      const NODE* node = stack.back();
+      stack.pop_back();
+      if(upper < node->Key)
+        break;
+
+      keys.push_back(node->Key);
+      cur = node->Right;
+    }
+
+    return keys;
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the tree; if the key has already been insert then
+  // the function returns without changing the tree. Only the nodes on the
+  // path to the new key that are shared with a snapshot are copied.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  void insert(const KeyT& key, const ValueT& value)
+  {
+    if(findNode(key) != nullptr)
+      return;
+
+    Root = insertPath(Root, key, value);
+    Size++;
+  }
+
+  //
+  // erase
+  //
+  // Removes the given key, returning true if it was found and false if
+  // not. Copies shared nodes the same way as insert().
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool erase(const KeyT& key)
+  {
+    if(findNode(key) == nullptr)
+      return false;
+
+    Root = erasePath(Root, key);
+    Size--;
+    return true;
+  }
+};
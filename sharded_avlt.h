@@ -0,0 +1,296 @@
+/*sharded_avlt.h*/
+
+//
+// Threaded AVL trees split by key range, for many concurrent writers
+//
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "avlt.h"
+
+//
+// sharded_avlt divides the keys into ranges at a sorted list of
+// splitters and keeps each range in its own avlt, the shard, with its
+// own lock. Shard i holds the keys from splitter i-1 (inclusive) up to
+// splitter i, so N splitters give N+1 shards. Writers only lock the
+// shard their key falls in, so writes to different shards run in
+// parallel, and lookups share a shard's lock with other lookups.
+//
+// The splitters are either given (say, known boundaries of the key
+// space) or picked from a sample of the keys with sample_splitters(),
+// which spreads uniformly distributed keys evenly. They don't change
+// afterwards, so a skewed key mix loads some shards more than others.
+//
+// Since the shards cover consecutive ranges, everything that walks the
+// keys in order (range_search, for_each) just goes through the shards
+// one after the other; no merging is needed. Unlike concurrent_avlt,
+// KeyT and ValueT can be any types avlt takes.
+//
+template<typename KeyT, typename ValueT, typename Compare = std::less<KeyT>,
+         typename Alloc = std::allocator<std::pair<const KeyT, ValueT>>>
+class sharded_avlt
+{
+private:
+  typedef avlt<KeyT, ValueT, Compare, Alloc> tree_type;
+
+  // on its own cache line, so writers of neighbouring shards don't
+  // slow each other down through the locks
+  struct alignas(64) Shard
+  {
+    mutable std::shared_mutex Lock;
+    tree_type Tree;
+
+    Shard(const Compare& comp, const Alloc& alloc)
+      : Tree(comp, alloc)
+    { }
+  };
+
+  typedef std::shared_lock<std::shared_mutex> ReadLock;
+  typedef std::lock_guard<std::shared_mutex>  WriteLock;
+
+  vector<KeyT> Splitters;             // sorted, no repeats
+  vector<unique_ptr<Shard>> Shards;   // Splitters.size() + 1 of them
+  Compare Less;                       // orders the keys
+
+	/* shardOf()
+	 *
+	 * index of the shard key belongs in: the # of splitters <= key
+	 */
+
+	size_t shardOf(const KeyT& key) const
+	{
+		return std::upper_bound(Splitters.begin(), Splitters.end(), key, Less) - Splitters.begin();
+	}
+
+public:
+
+  //
+  // constructor:
+  //
+  // Creates an empty map split at the given keys, in any order; with
+  // no splitters there is just one shard. See sample_splitters().
+  //
+  explicit sharded_avlt(vector<KeyT> splitters = vector<KeyT>(), const Compare& comp = Compare(),
+                        const Alloc& alloc = Alloc())
+    : Splitters(std::move(splitters)), Less(comp)
+  {
+    std::sort(Splitters.begin(), Splitters.end(), Less);
+    Splitters.erase(std::unique(Splitters.begin(), Splitters.end(),
+                                [this](const KeyT& a, const KeyT& b) { return !Less(a, b); }),
+                    Splitters.end());
+
+    for(size_t i = 0; i <= Splitters.size(); i++)
+      Shards.push_back(unique_ptr<Shard>(new Shard(Less, alloc)));
+  }
+
+  sharded_avlt(const sharded_avlt&) = delete;
+  sharded_avlt& operator=(const sharded_avlt&) = delete;
+
+  //
+  // sample_splitters
+  //
+  // Picks splitters for the given # of shards from a sample of the keys
+  // to be stored, at evenly spaced ranks, so each shard gets about the
+  // same share of keys distributed like the sample. Fewer splitters come
+  // back if the sample has too few distinct keys.
+  //
+  // Time complexity:  O(SlgS) for a sample of S keys
+  //
+  static vector<KeyT> sample_splitters(vector<KeyT> sample, size_t shards, const Compare& comp = Compare())
+  {
+    vector<KeyT> splitters;
+    if(shards < 2 || sample.empty())
+      return splitters;
+
+    std::sort(sample.begin(), sample.end(), comp);
+    for(size_t i = 1; i < shards; i++)
+    {
+      const KeyT& key = sample[i * sample.size() / shards];
+      if(splitters.empty() || comp(splitters.back(), key))
+        splitters.push_back(key);
+    }
+    return splitters;
+  }
+
+  //
+  // shard_count / splitters
+  //
+  // The # of shards, and the keys they are split at.
+  //
+  size_t shard_count() const
+  {
+    return Shards.size();
+  }
+
+  const vector<KeyT>& splitters() const
+  {
+    return Splitters;
+  }
+
+  //
+  // size:
+  //
+  // Returns the # of keys in all shards, 0 if empty. Each shard is
+  // counted as of some moment during the call.
+  //
+  // Time complexity:  O(# of shards)
+  //
+  int size() const
+  {
+    int total = 0;
+    for(const auto& shard : Shards)
+    {
+      ReadLock lock(shard->Lock);
+      total += shard->Tree.size();
+    }
+    return total;
+  }
+
+  //
+  // search:
+  //
+  // Searches for the given key, returning true if found and false if
+  // not.  If the key is found, the corresponding value is returned via
+  // the reference parameter. Shares the key's shard with other readers.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    const Shard& shard = *Shards[shardOf(key)];
+    ReadLock lock(shard.Lock);
+    return shard.Tree.search(key, value);
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    ValueT value{};
+    search(key, value);
+    return value;
+  }
+
+  //
+  // insert
+  //
+  // Same as avlt::insert; only waits for writers to the same shard.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  void insert(const KeyT& key, const ValueT& value)
+  {
+    Shard& shard = *Shards[shardOf(key)];
+    WriteLock lock(shard.Lock);
+    shard.Tree.insert(key, value);
+  }
+
+  //
+  // insert_batch
+  //
+  // Same as avlt::insert_batch: the batch is divided by shard, and each
+  // shard's part is inserted as one write to that shard.
+  //
+  void insert_batch(vector<pair<KeyT, ValueT>> batch)
+  {
+    vector<vector<pair<KeyT, ValueT>>> parts(Shards.size());
+    for(auto& p : batch)
+      parts[shardOf(p.first)].push_back(std::move(p));
+
+    for(size_t i = 0; i < parts.size(); i++)
+    {
+      if(parts[i].empty())
+        continue;
+
+      WriteLock lock(Shards[i]->Lock);
+      Shards[i]->Tree.insert_batch(std::move(parts[i]));
+    }
+  }
+
+  //
+  // erase
+  //
+  // Same as avlt::erase; only waits for writers to the same shard.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool erase(const KeyT& key)
+  {
+    Shard& shard = *Shards[shardOf(key)];
+    WriteLock lock(shard.Lock);
+    return shard.Tree.erase(key);
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive, in order.
+  // Every shard the range touches is read-locked, first to last, for
+  // the whole scan, so the keys are one consistent view.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+    if(Less(upper, lower))
+      return keys;
+
+    size_t first = shardOf(lower);
+    size_t last = shardOf(upper);
+
+    vector<ReadLock> locks;
+    for(size_t i = first; i <= last; i++)
+      locks.push_back(ReadLock(Shards[i]->Lock));
+
+    for(size_t i = first; i <= last; i++)
+      Shards[i]->Tree.range_search(lower, upper, std::back_inserter(keys));
+    return keys;
+  }
+
+  //
+  // for_each
+  //
+  // Calls fn(key, value) for every key in order. Each shard is
+  // read-locked while its keys are visited, one shard at a time, so
+  // writers to other shards aren't held up by a long scan.
+  //
+  // Time complexity:  O(N)
+  //
+  template<typename Fn>
+  void for_each(Fn fn) const
+  {
+    for(const auto& shard : Shards)
+    {
+      ReadLock lock(shard->Lock);
+      for(auto it = shard->Tree.cbegin(); it != shard->Tree.cend(); ++it)
+        fn(it.key(), it.value());
+    }
+  }
+
+  //
+  // clear:
+  //
+  // Empties every shard; the splitters stay.
+  //
+  void clear()
+  {
+    for(auto& shard : Shards)
+    {
+      WriteLock lock(shard->Lock);
+      shard->Tree.clear();
+    }
+  }
+};
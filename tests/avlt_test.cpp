@@ -0,0 +1,658 @@
+/*avlt_test.cpp*/
+
+//
+// Unit tests for avlt, mostly checked against std::map doing the same
+// thing
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "avlt.h"
+#include "test_check.h"
+
+// keys of m, in order
+template<typename Map>
+static vector<typename Map::key_type> keysOf(const Map& m)
+{
+  vector<typename Map::key_type> keys;
+  for(const auto& p : m)
+    keys.push_back(p.first);
+  return keys;
+}
+
+// keys of tree, in order, through the const_iterator
+template<typename Tree>
+static vector<typename std::iterator_traits<typename Tree::const_iterator>::value_type> keysOf(const Tree& tree, int)
+{
+  return vector<typename std::iterator_traits<typename Tree::const_iterator>::value_type>(tree.cbegin(), tree.cend());
+}
+
+// height never exceeds the AVL bound of about 1.44 lg(N+2)
+template<typename Tree>
+static bool balanced(const Tree& tree)
+{
+  return tree.height() <= 1.45 * std::log2(tree.size() + 2.0);
+}
+
+template<typename Tree, typename Map>
+static bool same(const Tree& tree, const Map& m)
+{
+  if(tree.size() != (int) m.size() || keysOf(tree, 0) != keysOf(m))
+    return false;
+
+  for(const auto& p : m)
+  {
+    typename Map::mapped_type value;
+    if(!tree.search(p.first, value) || !(value == p.second))
+      return false;
+  }
+  return true;
+}
+
+static void testEmpty()
+{
+  avlt<int, int> tree;
+  int value = 7;
+
+  CHECK(tree.size() == 0);
+  CHECK(tree.height() == -1);
+  CHECK(!tree.search(1, value) && value == 7);
+  CHECK(tree[1] == 0);
+  CHECK(tree(1) == 0);
+  CHECK(tree % 1 == -1);
+  CHECK(tree.range_search(0, 10).empty());
+  CHECK(tree.cbegin() == tree.cend());
+  CHECK(!tree.erase(1));
+
+  int key;
+  tree.begin();
+  CHECK(!tree.next(key));
+}
+
+static void testInsertSearchErase()
+{
+  avlt<int, int> tree;
+  std::map<int, int> m;
+  std::mt19937 rng(1);
+
+  for(int i = 0; i < 50000; i++)
+  {
+    int key = rng() % 5000;
+    if(rng() % 3 != 0)
+    {
+      tree.insert(key, i);
+      m.emplace(key, i);  // like insert, keeps the first value
+    }
+    else
+      CHECK(tree.erase(key) == (m.erase(key) == 1));
+  }
+
+  CHECK(same(tree, m));
+  CHECK(balanced(tree));
+
+  for(int key = -10; key < 5010; key++)
+  {
+    auto it = m.find(key);
+    CHECK(tree[key] == (it == m.end() ? 0 : it->second));
+    CHECK((tree.find(key) == tree.cend()) == (it == m.end()));
+    CHECK((tree % key >= 0) == (it != m.end()));
+  }
+
+  // erasing everything leaves a working empty tree
+  for(const auto& p : m)
+    CHECK(tree.erase(p.first));
+  CHECK(tree.size() == 0 && tree.height() == -1);
+  tree.insert(3, 4);
+  CHECK(tree[3] == 4);
+}
+
+static void testSequentialInsertsStayBalanced()
+{
+  avlt<int, int> up, down;
+  for(int i = 0; i < 10000; i++)
+  {
+    up.insert(i, i);
+    down.insert(-i, i);
+  }
+  CHECK(balanced(up) && balanced(down));
+  CHECK(up.height() == 13 && down.height() == 13);
+}
+
+static void testIteration()
+{
+  avlt<int, int> tree;
+  std::map<int, int> m;
+  for(int i = 0; i < 1000; i++)
+  {
+    tree.insert((i * 37) % 1000, i);
+    m.emplace((i * 37) % 1000, i);
+  }
+
+  vector<int> keys;
+  int key;
+  tree.begin();
+  while(tree.next(key))
+    keys.push_back(key);
+  CHECK(keys == keysOf(m));
+
+  // begin()/next() don't disturb lookups or copies half way through
+  tree.begin();
+  tree.next(key);
+  tree.next(key);
+  CHECK(tree.range_search(10, 20) == vector<int>({10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20}));
+  avlt<int, int> copy(tree);
+  CHECK(same(copy, m));
+
+  // erasing the node next() is about to return moves it along
+  tree.begin();
+  tree.next(key);  // 0
+  tree.erase(1);
+  CHECK(tree.next(key) && key == 2);
+
+  auto it = tree.lower_bound(500);
+  CHECK(it != tree.cend() && *it == 500 && it.value() == m[500]);
+  CHECK(*tree.upper_bound(500) == 501);
+  CHECK(tree.lower_bound(1000) == tree.cend());
+}
+
+static void testRanges()
+{
+  typedef avlt<int, int> tree_type;
+  tree_type tree;
+  std::map<int, int> m;
+  std::mt19937 rng(2);
+  for(int i = 0; i < 3000; i++)
+  {
+    int key = rng() % 6000;
+    tree.insert(key, key * 2);
+    m.emplace(key, key * 2);
+  }
+
+  for(int i = 0; i < 500; i++)
+  {
+    int lower = (int) (rng() % 6200) - 100;
+    int upper = lower + rng() % 300;
+
+    vector<int> expected(keysOf(std::map<int, int>(m.lower_bound(lower), m.upper_bound(upper))));
+    CHECK(tree.range_search(lower, upper) == expected);
+
+    const tree_type::range_bounds bounds[] = { tree_type::closed, tree_type::half_open,
+                                               tree_type::left_open, tree_type::open };
+    for(tree_type::range_bounds b : bounds)
+    {
+      vector<int> want;
+      for(int key : expected)
+        if(!((b == tree_type::left_open || b == tree_type::open) && key == lower) &&
+           !((b == tree_type::half_open || b == tree_type::open) && key == upper))
+          want.push_back(key);
+
+      vector<int> got;
+      bool valuesOk = true;
+      size_t visited = tree.range_for_each(lower, upper, [&](const int& key, const int& value) {
+        got.push_back(key);
+        valuesOk = valuesOk && value == key * 2;
+      }, b);
+      CHECK(got == want && visited == want.size() && valuesOk);
+
+      vector<int> out;
+      tree.range_search(lower, upper, std::back_inserter(out), b);
+      CHECK(out == want);
+    }
+
+    // returning false stops the scan
+    size_t calls = 0;
+    size_t visited = tree.range_for_each(lower, upper, [&](const int&, const int&) { return ++calls < 3; });
+    CHECK(visited == std::min<size_t>(3, expected.size()) && calls == visited);
+  }
+}
+
+static void testCopyMoveSwap()
+{
+  avlt<std::string, std::string> tree;
+  std::map<std::string, std::string> m;
+  for(int i = 0; i < 2000; i++)
+  {
+    tree.insert(std::to_string(i * 7), std::string(i % 50, 'v'));
+    m.emplace(std::to_string(i * 7), std::string(i % 50, 'v'));
+  }
+
+  avlt<std::string, std::string> copy(tree);
+  CHECK(same(copy, m) && copy.height() == tree.height());
+
+  avlt<std::string, std::string> assigned;
+  assigned.insert("x", "y");
+  assigned = tree;
+  CHECK(same(assigned, m));
+  assigned = assigned;
+  CHECK(same(assigned, m));
+
+  avlt<std::string, std::string> parallel;
+  parallel.copy_from(tree, 4);
+  CHECK(same(parallel, m) && parallel.height() == tree.height());
+
+  avlt<std::string, std::string> moved(std::move(copy));
+  CHECK(same(moved, m) && copy.size() == 0);
+  copy.insert("still", "works");
+  CHECK(copy.size() == 1);
+
+  swap(moved, copy);
+  CHECK(same(copy, m) && moved.size() == 1);
+
+  moved = std::move(copy);
+  CHECK(same(moved, m));
+
+  moved.clear();
+  CHECK(moved.size() == 0 && moved.cbegin() == moved.cend());
+  CHECK(same(tree, m));  // copies never shared nodes with the original
+}
+
+static void testBulkAndBatch()
+{
+  vector<pair<int, int>> sorted;
+  for(int i = 0; i < 10000; i++)
+    sorted.push_back(make_pair(i / 2, i));  // each key twice; first value wins
+
+  avlt<int, int> bulk(sorted.begin(), sorted.end());
+  CHECK(bulk.size() == 5000 && balanced(bulk));
+  CHECK(bulk[10] == 20 && bulk[4999] == 9998);
+
+  vector<pair<int, int>> unsorted(sorted.rbegin(), sorted.rend());
+  avlt<int, int> fallback(unsorted.begin(), unsorted.end());
+  CHECK(fallback.size() == 5000 && fallback[10] == 21);
+
+  // small batches take the finger inserts, large ones the rebuild
+  avlt<int, int> tree;
+  std::map<int, int> m;
+  std::mt19937 rng(3);
+  for(int round = 0; round < 50; round++)
+  {
+    vector<pair<int, int>> batch;
+    size_t n = (round % 5 == 0) ? 3000 : 40;
+    for(size_t i = 0; i < n; i++)
+      batch.push_back(make_pair((int) (rng() % 100000), round));
+    for(const auto& p : batch)
+      m.emplace(p.first, p.second);
+    tree.insert_batch(batch);
+  }
+  CHECK(same(tree, m) && balanced(tree));
+
+  vector<int> keys;
+  for(int i = 0; i < 2000; i++)
+    keys.push_back((int) (rng() % 100000));
+  vector<int> values;
+  vector<bool> found;
+  size_t count = tree.search_many(keys, values, found);
+  size_t expected = 0;
+  bool ok = true;
+  for(size_t i = 0; i < keys.size(); i++)
+  {
+    auto it = m.find(keys[i]);
+    expected += (it != m.end());
+    ok = ok && found[i] == (it != m.end()) && values[i] == (it == m.end() ? 0 : it->second);
+  }
+  CHECK(ok && count == expected);
+}
+
+static void testUpserts()
+{
+  avlt<std::string, std::vector<int>> tree;
+
+  auto r = tree.try_emplace("a", 3, 7);  // vector<int>(3, 7), built in the node
+  CHECK(r.second && r.first.value() == vector<int>(3, 7));
+  r = tree.try_emplace("a", 1, 1);
+  CHECK(!r.second && r.first.value() == vector<int>(3, 7));
+
+  r = tree.insert_or_assign("a", vector<int>(2, 2));
+  CHECK(!r.second && tree.find("a").value() == vector<int>(2, 2));
+  r = tree.insert_or_assign(std::string("b"), vector<int>(1, 1));
+  CHECK(r.second && tree.size() == 2);
+
+  vector<int>* value = tree.find_value("b");
+  CHECK(value != nullptr);
+  value->push_back(5);
+  CHECK(tree["b"] == vector<int>({1, 5}));
+  CHECK(tree.find_value("c") == nullptr);
+}
+
+static void testComparators()
+{
+  avlt<int, int, std::greater<int>> reversed;
+  for(int i = 0; i < 100; i++)
+    reversed.insert(i, i);
+  CHECK(*reversed.cbegin() == 99);
+  CHECK(reversed.range_search(10, 5) == vector<int>({10, 9, 8, 7, 6, 5}));
+  CHECK(reversed.erase(50) && reversed.size() == 99 && balanced(reversed));
+
+  // transparent lookups with string_view
+  avlt<std::string, int, std::less<>> names;
+  names.insert("alpha", 1);
+  names.insert("beta", 2);
+  int value = 0;
+  std::string_view beta("beta");
+  CHECK(names.search(beta, value) && value == 2);
+  CHECK(names[std::string_view("alpha")] == 1);
+  CHECK(names.find(std::string_view("gamma")) == names.cend());
+  CHECK(*names.lower_bound(std::string_view("b")) == "beta");
+}
+
+// which arena handed out each block still in use, and how many blocks
+// came back to the wrong one
+struct ArenaLog
+{
+  std::map<void*, int> Owners;
+  int Mismatches = 0;
+};
+
+// a stateful allocator that follows the tree on move assignment but not
+// on swap; arenas are only equal to themselves
+template<typename T>
+struct ArenaAlloc
+{
+  typedef T value_type;
+  typedef std::true_type  propagate_on_container_move_assignment;
+  typedef std::false_type propagate_on_container_swap;
+  typedef std::false_type is_always_equal;
+
+  int Arena;
+  ArenaLog* Log;
+
+  ArenaAlloc(int arena, ArenaLog* log) : Arena(arena), Log(log) { }
+
+  template<typename U>
+  ArenaAlloc(const ArenaAlloc<U>& other) : Arena(other.Arena), Log(other.Log) { }
+
+  T* allocate(size_t n)
+  {
+    T* p = std::allocator<T>().allocate(n);
+    Log->Owners[p] = Arena;
+    return p;
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    auto it = Log->Owners.find(p);
+    if(it == Log->Owners.end() || it->second != Arena)
+      Log->Mismatches++;
+    else
+      Log->Owners.erase(it);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template<typename U>
+  bool operator==(const ArenaAlloc<U>& other) const { return Arena == other.Arena; }
+  template<typename U>
+  bool operator!=(const ArenaAlloc<U>& other) const { return Arena != other.Arena; }
+};
+
+static void testAllocators()
+{
+  std::pmr::monotonic_buffer_resource arena;
+  typedef avlt<int, int, std::less<int>, std::pmr::polymorphic_allocator<std::pair<const int, int>>> pmr_tree;
+
+  pmr_tree tree{std::pmr::polymorphic_allocator<std::pair<const int, int>>(&arena)};
+  for(int i = 0; i < 1000; i++)
+    tree.insert(i, i);
+  CHECK(tree.size() == 1000 && tree.get_allocator().resource() == &arena);
+
+  pmr_tree copy(tree);
+  CHECK(copy.size() == 1000 && copy[999] == 999);
+  CHECK(tree.memory_usage() >= 1000 * sizeof(int) * 2);
+
+  // move assignment with unequal allocators that propagate on move but
+  // not on swap: the nodes and their allocator move over together
+  ArenaLog log;
+  {
+    typedef ArenaAlloc<std::pair<const int, int>> arena_alloc;
+    avlt<int, int, std::less<int>, arena_alloc> a(arena_alloc(1, &log)), b(arena_alloc(2, &log));
+    for(int i = 0; i < 1000; i++)
+      a.insert(i, i);
+    for(int i = 0; i < 100; i++)
+      b.insert(-i, i);
+
+    a = std::move(b);
+    CHECK(a.size() == 100 && b.size() == 0 && a[-99] == 99);
+    CHECK(a.get_allocator().Arena == 2);
+    for(int i = 0; i < 1000; i++)
+      a.insert(i, i);
+    CHECK(a.erase(-50) && a.size() == 1098);
+  }
+  CHECK(log.Mismatches == 0 && log.Owners.empty());
+}
+
+static void testFreeze()
+{
+  avlt<int, int> tree;
+  for(int i = 0; i < 1000; i++)
+    tree.insert(i * 3, i);
+
+  auto frozen = tree.freeze();
+  tree.insert(1, 1);  // doesn't show up in the frozen copy
+
+  int value;
+  CHECK(frozen.size() == 1000);
+  CHECK(frozen.search(300, value) && value == 100);
+  CHECK(!frozen.search(1, value));
+  CHECK(frozen[2997] == 999 && frozen[2998] == 0);
+  CHECK(frozen.range_search(0, 10) == vector<int>({0, 3, 6, 9}));
+}
+
+static void testSetOperations()
+{
+  std::mt19937 rng(7);
+  for(int round = 0; round < 40; round++)
+  {
+    avlt<int, int> a, b;
+    std::map<int, int> ma, mb;
+    int na = (round % 4 == 0) ? 20000 : (int) (rng() % 500);
+    int nb = (round % 3 == 0) ? 20000 : (int) (rng() % 500);
+    for(int i = 0; i < na; i++)
+    {
+      int key = (int) (rng() % 30000);
+      a.insert(key, i);
+      ma.emplace(key, i);
+    }
+    for(int i = 0; i < nb; i++)
+    {
+      int key = (int) (rng() % 30000);
+      b.insert(key, -i);
+      mb.emplace(key, -i);
+    }
+    unsigned threads = 1 + round % 4;
+
+    avlt<int, int> merged(a);
+    std::map<int, int> m = ma;
+    m.insert(mb.begin(), mb.end());  // keys already there keep their value
+    merged.merge(b, threads);
+    CHECK(same(merged, m) && balanced(merged));
+    CHECK(same(b, mb));
+
+    avlt<int, int> common(a);
+    m.clear();
+    for(const auto& p : ma)
+      if(mb.count(p.first))
+        m.insert(p);
+    common.intersect(b, threads);
+    CHECK(same(common, m) && balanced(common));
+
+    avlt<int, int> rest(a);
+    m.clear();
+    for(const auto& p : ma)
+      if(!mb.count(p.first))
+        m.insert(p);
+    rest.difference(b, threads);
+    CHECK(same(rest, m) && balanced(rest));
+
+    // still an ordinary tree afterwards
+    rest.insert(-1, 0);
+    m.emplace(-1, 0);
+    if(!m.empty())
+    {
+      CHECK(rest.erase(m.rbegin()->first));
+      m.erase(std::prev(m.end()));
+    }
+    CHECK(same(rest, m));
+  }
+
+  avlt<int, int> tree;
+  for(int i = 0; i < 100; i++)
+    tree.insert(i, i);
+  tree.merge(tree);
+  tree.intersect(tree);
+  CHECK(tree.size() == 100);
+  tree.difference(tree);
+  CHECK(tree.size() == 0);
+}
+
+static void testSplitJoinAndRanges()
+{
+  std::mt19937 rng(8);
+  for(int round = 0; round < 30; round++)
+  {
+    avlt<int, std::string> tree;
+    std::map<int, std::string> m;
+    int n = (round % 3 == 0) ? 20000 : (int) (rng() % 300);
+    for(int i = 0; i < n; i++)
+    {
+      int key = (int) (rng() % 40000);
+      tree.insert(key, std::to_string(i));
+      m.emplace(key, std::to_string(i));
+    }
+    int lower = (int) (rng() % 40000) - 100;
+    int upper = lower + (int) (rng() % 20000);
+
+    // split and join back, both ways round in size
+    avlt<int, std::string> high = tree.split(lower);
+    CHECK(same(tree, std::map<int, std::string>(m.begin(), m.lower_bound(lower))) && balanced(tree));
+    CHECK(same(high, std::map<int, std::string>(m.lower_bound(lower), m.end())) && balanced(high));
+    tree.join(high);
+    CHECK(same(tree, m) && high.size() == 0);
+
+    avlt<int, std::string> range = tree.extract_range(lower, upper);
+    std::map<int, std::string> inRange(m.lower_bound(lower), m.upper_bound(upper));
+    m.erase(m.lower_bound(lower), m.upper_bound(upper));
+    CHECK(same(range, inRange) && balanced(range));
+    CHECK(same(tree, m) && balanced(tree));
+
+    // and put back: the range overlaps the rest, so this merges
+    tree.join(range);
+    m.insert(inRange.begin(), inRange.end());
+    CHECK(same(tree, m) && range.size() == 0);
+
+    int erased = tree.erase_range(lower, upper);
+    CHECK(erased == (int) inRange.size());
+    m.erase(m.lower_bound(lower), m.upper_bound(upper));
+    CHECK(same(tree, m) && balanced(tree));
+
+    tree.insert(lower, "back");
+    m.emplace(lower, "back");
+    CHECK(same(tree, m));
+  }
+
+  avlt<int, int> tree;
+  for(int i = 0; i < 1000; i++)
+    tree.insert(i, i);
+  CHECK(tree.erase_range(10, 5) == 0 && tree.size() == 1000);
+  CHECK(tree.extract_range(2000, 3000).size() == 0);
+  CHECK(tree.split(-1).size() == 1000 && tree.size() == 0);
+}
+
+static void testParallelScans()
+{
+  std::mt19937 rng(9);
+  avlt<int, long long> tree;
+  std::map<int, long long> m;
+  for(int i = 0; i < 50000; i++)
+  {
+    int key = (int) (rng() % 200000);
+    tree.insert(key, key * 3LL);
+    m.emplace(key, key * 3LL);
+  }
+
+  auto sum = [](long long a, long long b) { return a + b; };
+  long long all = 0;
+  for(auto& p : m)
+    all += p.second;
+
+  for(unsigned threads : { 1u, 2u, 5u })
+  {
+    CHECK(tree.parallel_reduce(0LL, sum, threads) == all);
+
+    std::atomic<size_t> visited(0);
+    tree.parallel_for_each([&visited](const int& key, const long long& value) {
+      if(value == key * 3LL)
+        visited++;
+    }, threads);
+    CHECK(visited == m.size());
+
+    for(int i = 0; i < 50; i++)
+    {
+      int lower = (int) (rng() % 200000) - 10;
+      int upper = lower + (int) (rng() % 60000);
+
+      long long expected = 0;
+      vector<int> keys;
+      for(auto it = m.lower_bound(lower); it != m.end() && it->first <= upper; ++it)
+      {
+        expected += it->second;
+        keys.push_back(it->first);
+      }
+      CHECK(tree.parallel_reduce(lower, upper, 0LL, sum, threads) == expected);
+
+      // chunks come back in any order, each key once
+      std::mutex lock;
+      vector<int> seen;
+      tree.parallel_for_each(lower, upper, [&](const int& key, const long long&) {
+        std::lock_guard<std::mutex> guard(lock);
+        seen.push_back(key);
+      }, threads);
+      std::sort(seen.begin(), seen.end());
+      CHECK(seen == keys);
+    }
+    CHECK(tree.parallel_reduce(10, 5, -1LL, sum, threads) == -1);
+  }
+
+  // chunks are folded in key order, so op needn't be commutative
+  avlt<int, std::string> words;
+  std::string expected;
+  for(int i = 0; i < 10000; i++)
+  {
+    words.insert(i, std::to_string(i) + " ");
+    expected += std::to_string(i) + " ";
+  }
+  auto concat = [](std::string a, std::string b) { return a + b; };
+  CHECK(words.parallel_reduce(std::string(), concat, 4) == expected);
+  words.clear();
+  CHECK(words.parallel_reduce(std::string("empty"), concat, 4) == "empty");
+}
+
+int main()
+{
+  testEmpty();
+  testInsertSearchErase();
+  testSequentialInsertsStayBalanced();
+  testIteration();
+  testRanges();
+  testCopyMoveSwap();
+  testBulkAndBatch();
+  testUpserts();
+  testComparators();
+  testAllocators();
+  testFreeze();
+  testSetOperations();
+  testSplitJoinAndRanges();
+  testParallelScans();
+
+  return test_result("avlt_test");
+}
@@ -0,0 +1,117 @@
+/*insert_alloc_test.cpp*/
+
+//
+// Checks that inserting allocates nothing but the nodes themselves: no
+// per-insert bookkeeping on the heap, and no allocation at all once the
+// pool already has room.
+//
+// Every global operator new is counted, so anything that allocates
+// behind the tree's back (containers used as scratch space, ...) shows
+// up, not just what goes through the tree's allocator.
+//
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "avlt.h"
+#include "test_check.h"
+
+static size_t Allocations = 0;
+
+void* operator new(size_t size)
+{
+  Allocations++;
+  void* p = malloc(size == 0 ? 1 : size);
+  if(p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+// # of slabs a pool needs for count nodes, doubling from 64 up to 1<<16
+static size_t slabsFor(size_t count)
+{
+  size_t slabs = 0;
+  size_t slab = 64;
+  for(size_t have = 0; have < count; slabs++)
+  {
+    have += slab;
+    if(slab < (1u << 16))
+      slab *= 2;
+  }
+  return slabs;
+}
+
+int main()
+{
+  const int N = 100000;
+
+  // a fresh tree only allocates when its pool needs another slab; the
+  // list of slabs lives in the slabs, so that is all it allocates
+  {
+    avlt<int, int> tree;
+
+    size_t before = Allocations;
+    for(int i = 0; i < N; i++)
+      tree.insert((i * 7919) % N, i);
+    CHECK(Allocations - before == slabsFor(N));
+  }
+
+  // once the pool has free slots, inserts allocate nothing at all
+  {
+    avlt<int, int> tree;
+    for(int i = 0; i < N; i++)
+      tree.insert(i, i);
+    for(int i = 0; i < N; i++)
+      tree.erase(i);
+
+    size_t before = Allocations;
+    for(int i = 0; i < N; i++)
+      tree.insert((i * 7919) % N, i);
+    CHECK(Allocations == before);  // insert with free slots in the pool
+
+    before = Allocations;
+    for(int i = 0; i < N; i++)
+      tree.insert(i, -i);  // already there
+    CHECK(Allocations == before);  // keys already in the tree
+
+    before = Allocations;
+    for(int i = 0; i < N; i++)
+      tree.erase(i);
+    for(int i = 0; i < N; i++)
+    {
+      tree.try_emplace(i, i);
+      tree.insert_or_assign(i, -i);
+    }
+    CHECK(Allocations == before);  // try_emplace / insert_or_assign
+  }
+
+  // with string keys, the only allocations left are the strings' own
+  {
+    avlt<std::string, int> tree;
+    std::string keys[64];
+    for(int i = 0; i < 64; i++)
+      keys[i] = std::to_string(i);  // short enough to be stored inline
+    for(int i = 0; i < 64; i++)
+      tree.insert(keys[i], i);
+    for(int i = 0; i < 64; i++)
+      tree.erase(keys[i]);
+
+    size_t before = Allocations;
+    for(int i = 0; i < 64; i++)
+      tree.insert(keys[i], i);
+    CHECK(Allocations == before);
+  }
+
+  return test_result("insert_alloc_test");
+}
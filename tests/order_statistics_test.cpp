@@ -0,0 +1,97 @@
+/*order_statistics_test.cpp*/
+
+//
+// Unit tests for rank, select and range_count, which only exist with
+// AVLT_ORDER_STATISTICS
+//
+
+#define AVLT_ORDER_STATISTICS
+
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "avlt.h"
+#include "test_check.h"
+
+typedef avlt<int, int> tree_type;
+
+// checks every order statistic of tree against m
+static void checkAgainst(const tree_type& tree, const std::map<int, int>& m, std::mt19937& rng)
+{
+  for(int i = 0; i < 200; i++)
+  {
+    int key = (int) (rng() % 4200) - 100;
+    CHECK(tree.rank(key) == (int) std::distance(m.begin(), m.lower_bound(key)));
+
+    int upper = key + rng() % 500;
+    const tree_type::range_bounds bounds[] = { tree_type::closed, tree_type::half_open,
+                                               tree_type::left_open, tree_type::open };
+    for(tree_type::range_bounds b : bounds)
+    {
+      std::vector<int> keys;
+      tree.range_search(key, upper, std::back_inserter(keys), b);
+      CHECK(tree.range_count(key, upper, b) == (int) keys.size());
+    }
+    CHECK(tree.range_count(upper + 1, key) == 0);
+  }
+
+  int i = 0;
+  for(const auto& p : m)
+  {
+    auto it = tree.select(i++);
+    CHECK(it != tree.cend() && *it == p.first && it.value() == p.second);
+  }
+  CHECK(tree.select(tree.size()) == tree.cend());
+}
+
+int main()
+{
+  tree_type tree;
+  std::map<int, int> m;
+  std::mt19937 rng(5);
+
+  // every kind of change has to keep the subtree sizes right
+  for(int round = 0; round < 20; round++)
+  {
+    for(int i = 0; i < 1000; i++)
+    {
+      int key = rng() % 4000;
+      if(rng() % 3 != 0)
+      {
+        tree.insert(key, key);
+        m.emplace(key, key);
+      }
+      else
+      {
+        tree.erase(key);
+        m.erase(key);
+      }
+    }
+
+    std::vector<std::pair<int, int>> batch;
+    for(int i = 0; i < ((round % 4 == 0) ? 2000 : 30); i++)
+    {
+      int key = rng() % 4000;
+      batch.push_back(std::make_pair(key, key));
+      m.emplace(key, key);
+    }
+    tree.insert_batch(batch);
+
+    checkAgainst(tree, m, rng);
+  }
+
+  tree_type copy(tree);
+  checkAgainst(copy, m, rng);
+
+  tree_type parallel;
+  parallel.copy_from(tree, 3);
+  checkAgainst(parallel, m, rng);
+
+  std::vector<std::pair<int, int>> sorted(m.begin(), m.end());
+  tree_type bulk(sorted.begin(), sorted.end());
+  checkAgainst(bulk, m, rng);
+
+  return test_result("order_statistics_test");
+}
@@ -0,0 +1,246 @@
+/*snapshot_test.cpp*/
+
+//
+// Unit tests for avlt::save / avlt::load and mapped_avlt
+//
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "avlt.h"
+#include "mapped_avlt.h"
+#include "test_check.h"
+
+struct Point
+{
+  double X, Y;
+};
+
+// what a snapshot is supposed to hold: the tree's contents, in order,
+// and (once materialized) the tree's shape
+template<typename Tree>
+static void checkSameShape(Tree& a, Tree& b)
+{
+  CHECK(a.size() == b.size());
+  CHECK(a.height() == b.height());
+
+  std::vector<int> keysA, keysB;
+  int key;
+  a.begin();
+  while(a.next(key))
+    keysA.push_back(key);
+  b.begin();
+  while(b.next(key))
+    keysB.push_back(key);
+  CHECK(keysA == keysB);
+}
+
+static void testRoundTrip(const char* path)
+{
+  avlt<int, int> tree;
+  std::map<int, int> m;
+  std::mt19937 rng(41);
+  for(int i = 0; i < 50000; i++)
+  {
+    int key = (int) (rng() % 200000);
+    tree.insert(key, i);
+    m.emplace(key, i);
+  }
+  for(int i = 0; i < 10000; i++)
+  {
+    int key = (int) (rng() % 200000);
+    CHECK(tree.erase(key) == (m.erase(key) == 1));
+  }
+
+  CHECK(tree.save(path));
+
+  mapped_avlt<int, int> mapped = avlt<int, int>::load(path);
+  CHECK(mapped.is_open());
+  CHECK(mapped.size() == tree.size());
+  CHECK(mapped.height() == tree.height());
+
+  for(int k = -5; k < 200005; k += 7)
+  {
+    auto it = m.find(k);
+    int value = -1;
+    CHECK(mapped.search(k, value) == (it != m.end()));
+    CHECK(mapped[k] == (it == m.end() ? 0 : it->second));
+    const int* p = mapped.find_value(k);
+    CHECK((p != nullptr) == (it != m.end()));
+    if(it != m.end())
+      CHECK(value == it->second && *p == it->second);
+  }
+
+  for(int i = 0; i < 200; i++)
+  {
+    int lower = (int) (rng() % 200000) - 10;
+    int upper = lower + (int) (rng() % 500);
+    CHECK(mapped.range_search(lower, upper) == tree.range_search(lower, upper));
+  }
+
+  // materialize gives back the same tree, which can be changed again
+  avlt<int, int> copy = mapped.materialize();
+  checkSameShape(copy, tree);
+  for(auto& p : m)
+    CHECK(copy[p.first] == p.second);
+  copy.insert(-1, -1);
+  CHECK(copy.erase(m.begin()->first));
+  CHECK(copy.size() == tree.size());
+
+  // a moved mapping keeps serving reads
+  mapped_avlt<int, int> moved(std::move(mapped));
+  CHECK(!mapped.is_open() && mapped.size() == 0);
+  CHECK(moved.is_open() && moved[m.begin()->first] == m.begin()->second);
+}
+
+static void testEmptyAndStructs(const char* path)
+{
+  avlt<int, Point> empty;
+  CHECK(empty.save(path));
+  mapped_avlt<int, Point> mapped(path);
+  CHECK(mapped.is_open() && mapped.size() == 0 && mapped.height() == -1);
+  Point point;
+  CHECK(!mapped.search(1, point));
+  CHECK(mapped.materialize().size() == 0);
+
+  avlt<int, Point> tree;
+  for(int i = 0; i < 1000; i++)
+    tree.insert(i, Point{i * 0.5, -i * 1.0});
+  CHECK(tree.save(path));
+  CHECK(mapped.open(path));
+  CHECK(mapped.size() == 1000);
+  CHECK(mapped.search(500, point) && point.X == 250.0 && point.Y == -500.0);
+}
+
+static void testBadFiles(const char* path)
+{
+  mapped_avlt<int, int> mapped;
+  CHECK(!mapped.open("no/such/snapshot.bin"));
+  CHECK(!mapped.is_open() && mapped.size() == 0 && mapped[3] == 0);
+
+  // a file that isn't a snapshot
+  FILE* out = fopen(path, "wb");
+  fputs("this is not a snapshot of anything, just some text long enough for a header", out);
+  fclose(out);
+  CHECK(!mapped.open(path));
+
+  // a snapshot of other key / value types
+  avlt<int, double> doubles;
+  doubles.insert(1, 1.5);
+  CHECK(doubles.save(path));
+  CHECK(!mapped.open(path));
+  mapped_avlt<int, double> right(path);
+  CHECK(right.is_open() && right[1] == 1.5);
+
+  // a truncated snapshot
+  avlt<int, int> tree;
+  for(int i = 0; i < 100; i++)
+    tree.insert(i, i);
+  CHECK(tree.save(path));
+  CHECK(mapped.open(path));
+  mapped.close();
+  CHECK(!mapped.is_open());
+
+  std::vector<char> bytes;
+  FILE* in = fopen(path, "rb");
+  for(int c; (c = fgetc(in)) != EOF; )
+    bytes.push_back((char) c);
+  fclose(in);
+  out = fopen(path, "wb");
+  fwrite(bytes.data(), 1, bytes.size() - 1, out);
+  fclose(out);
+  CHECK(!mapped.open(path));
+}
+
+// overwrites the 32-bit field at offset in the file at path
+static void patch(const char* path, long offset, int32_t value)
+{
+  FILE* file = fopen(path, "r+b");
+  fseek(file, offset, SEEK_SET);
+  fwrite(&value, sizeof(value), 1, file);
+  fclose(file);
+}
+
+static void testCorruptRecords(const char* path)
+{
+  // right size, right header, but records that don't make the tree:
+  // each is a fresh save of keys 0..99 with one field changed
+  const long RootField = 28, HeightField = 40;
+  const long Records = 64, RecordSize = 16, LeftField = 8, RightField = 12;
+
+  avlt<int, int> tree;
+  for(int i = 0; i < 100; i++)
+    tree.insert(i, i);
+
+  mapped_avlt<int, int> mapped;
+  CHECK(tree.save(path) && mapped.open(path));
+  mapped.close();
+
+  // the root is the 64th record, since the keys were inserted in order;
+  // record 0 is a leaf
+  int32_t root = 0;
+  FILE* in = fopen(path, "rb");
+  fseek(in, RootField, SEEK_SET);
+  CHECK(fread(&root, sizeof(root), 1, in) == 1);
+  fclose(in);
+
+  struct Damage { long Offset; int32_t Value; };
+  Damage damages[] = {
+    { Records + root * RecordSize + LeftField, 100 },     // child past the last record
+    { Records + root * RecordSize + LeftField, -7 },      // negative child
+    { Records + root * RecordSize + LeftField, root },    // cycle back to the root
+    { Records + 0 * RecordSize + RightField, root },      // leaf pointing back up
+    { Records + 0 * RecordSize + LeftField, 1 },          // record reached twice
+    { Records + 50 * RecordSize, 1000 },                  // key out of order
+    { HeightField, 2 },                                   // deeper than the saved height
+    { RootField, 0 },                                     // root that leaves records out
+  };
+
+  for(const Damage& damage : damages)
+  {
+    CHECK(tree.save(path));
+    patch(path, damage.Offset, damage.Value);
+    CHECK(!mapped.open(path));
+    CHECK(!mapped.is_open() && mapped.size() == 0);
+  }
+
+  // and the undamaged file still opens
+  CHECK(tree.save(path) && mapped.open(path) && mapped[42] == 42);
+}
+
+// a tree bigger than save()'s buffer, so some right links are filled in
+// after their records have already been written out
+static void testLargeSave(const char* path)
+{
+  avlt<int, int> tree;
+  const int N = 300000;
+  for(int i = 0; i < N; i++)
+    tree.insert(i * 2, -i);
+  CHECK(tree.save(path));
+
+  mapped_avlt<int, int> mapped(path);  // open() checks every link
+  CHECK(mapped.is_open() && mapped.size() == N && mapped.height() == tree.height());
+  for(int i = 0; i < N; i += 997)
+    CHECK(mapped[i * 2] == -i && mapped[i * 2 + 1] == 0);
+  CHECK(mapped.range_search(100001, 100010) == std::vector<int>({100002, 100004, 100006, 100008, 100010}));
+
+  avlt<int, int> copy = mapped.materialize();
+  checkSameShape(copy, tree);
+}
+
+int main()
+{
+  const char* path = "snapshot_test.bin";
+
+  testRoundTrip(path);
+  testEmptyAndStructs(path);
+  testBadFiles(path);
+  testCorruptRecords(path);
+  testLargeSave(path);
+
+  remove(path);
+  return test_result("snapshot_test");
+}
@@ -0,0 +1,106 @@
+/*stats_test.cpp*/
+
+//
+// Unit tests for stats() and reset_stats(), which only exist with
+// AVLT_STATS
+//
+
+#define AVLT_STATS
+
+#include <vector>
+
+#include "avlt.h"
+#include "test_check.h"
+
+static unsigned long long total(const unsigned long long* histogram)
+{
+  unsigned long long sum = 0;
+  for(int i = 0; i < avlt_stats::Buckets; i++)
+    sum += histogram[i];
+  return sum;
+}
+
+// every count in s is zero
+static bool isZero(const avlt_stats& s)
+{
+  return s.Rotations == 0 && s.Inserts == 0 && s.Searches == 0 && s.SearchComparisons == 0 &&
+         s.NodeAllocations == 0 && s.NodeFrees == 0 &&
+         total(s.RebalanceDepths) == 0 && total(s.PathLengths) == 0;
+}
+
+int main()
+{
+  const int N = 10000;
+  avlt<int, int> tree;
+  CHECK(isZero(tree.stats()));
+
+  // ascending keys always land on the right edge, so they rotate a lot
+  for(int i = 0; i < N; i++)
+    tree.insert(i, i);
+
+  avlt_stats s = tree.stats();
+  CHECK(s.Inserts == N);
+  CHECK(s.NodeAllocations == N);
+  CHECK(s.NodeFrees == 0);
+  CHECK(s.Rotations >= N / 2);
+  CHECK(total(s.RebalanceDepths) == N);
+  CHECK(total(s.PathLengths) == N);
+  CHECK(s.Searches == 0);
+
+  // keys already there don't insert, allocate or rebalance
+  for(int i = 0; i < N; i++)
+    tree.insert(i, -i);
+  s = tree.stats();
+  CHECK(s.Inserts == N && s.NodeAllocations == N);
+  CHECK(total(s.RebalanceDepths) == N);
+
+  tree.reset_stats();
+  CHECK(isZero(tree.stats()));
+
+  // each search descends at most height+1 nodes, one comparison per
+  // node plus the equality check at the bottom
+  for(int i = 0; i < N; i++)
+  {
+    int value;
+    tree.search(i, value);
+  }
+  s = tree.stats();
+  CHECK(s.Searches == N);
+  CHECK(total(s.PathLengths) == N);
+  for(int i = tree.height() + 2; i < avlt_stats::Buckets; i++)
+    CHECK(s.PathLengths[i] == 0);
+  CHECK(s.SearchComparisons <= (unsigned long long) N * (tree.height() + 2));
+  CHECK(s.SearchComparisons > (unsigned long long) N * tree.height() / 2);
+  CHECK(s.Rotations == 0 && s.Inserts == 0 && s.NodeAllocations == 0);
+
+  std::vector<int> keys;
+  std::vector<int> values;
+  std::vector<bool> found;
+  for(int i = 0; i < 100; i++)
+    keys.push_back(i * 3);
+  tree.reset_stats();
+  tree.search_many(keys, values, found);
+  CHECK(tree.stats().Searches == keys.size());
+
+  // a copy counts its own nodes, the original isn't charged for them
+  tree.reset_stats();
+  avlt<int, int> other(tree);
+  CHECK(other.stats().NodeAllocations == N);
+  CHECK(tree.stats().NodeAllocations == 0);
+
+  for(int i = 0; i < N; i += 2)
+    tree.erase(i);
+  CHECK(tree.stats().NodeFrees == N / 2);
+  tree.clear();
+  CHECK(tree.stats().NodeFrees == N);
+
+  // insert_or_assign goes through the same insert as insert()
+  tree.reset_stats();
+  for(int i = 0; i < N; i++)
+    tree.insert_or_assign(i, i);
+  s = tree.stats();
+  CHECK(s.Inserts == N && s.NodeAllocations == N);
+  CHECK(total(s.PathLengths) == N);
+
+  return test_result("stats_test");
+}
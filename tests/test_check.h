@@ -0,0 +1,30 @@
+/*test_check.h*/
+
+//
+// Minimal checking for the unit tests: CHECK reports every failed
+// condition with its line and keeps going, and test_result() is what
+// main returns.
+//
+
+#pragma once
+
+#include <cstdio>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                        \
+  do {                                                                     \
+    if(!(cond)) {                                                          \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                                     \
+    }                                                                      \
+  } while(0)
+
+static int test_result(const char* name)
+{
+  if(test_failures == 0)
+    printf("%s: all checks passed\n", name);
+  else
+    printf("%s: %d checks FAILED\n", name, test_failures);
+  return (test_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+/*variants_test.cpp*/
+
+//
+// Unit tests for the other trees built around avlt: compact_avlt,
+// wide_avlt, persistent_avlt, concurrent_avlt and sharded_avlt
+//
+
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "avlt.h"
+#include "compact_avlt.h"
+#include "concurrent_avlt.h"
+#include "persistent_avlt.h"
+#include "sharded_avlt.h"
+#include "wide_avlt.h"
+#include "test_check.h"
+
+template<typename Map>
+static vector<typename Map::key_type> keysOf(const Map& m)
+{
+  vector<typename Map::key_type> keys;
+  for(const auto& p : m)
+    keys.push_back(p.first);
+  return keys;
+}
+
+// what every tree has in common: insert, search, [], range_search and
+// begin()/next(), checked against std::map
+template<typename Tree, typename MakeKey>
+static void checkCommon(Tree& tree, MakeKey makeKey, unsigned seed)
+{
+  typedef decltype(makeKey(0)) key_type;
+  std::map<key_type, int> m;
+  std::mt19937 rng(seed);
+
+  for(int i = 0; i < 20000; i++)
+  {
+    key_type key = makeKey(rng() % 8000);
+    tree.insert(key, i);
+    m.emplace(key, i);
+  }
+
+  CHECK(tree.size() == (int) m.size());
+  for(int k = 0; k < 8000; k += 3)
+  {
+    key_type key = makeKey(k);
+    auto it = m.find(key);
+    int value = -1;
+    CHECK(tree.search(key, value) == (it != m.end()));
+    CHECK(tree[key] == (it == m.end() ? 0 : it->second));
+    if(it != m.end())
+      CHECK(value == it->second);
+  }
+
+  for(int i = 0; i < 200; i++)
+  {
+    int a = rng() % 8000;
+    key_type lower = makeKey(a), upper = makeKey(a + rng() % 200);
+    if(upper < lower)
+      std::swap(lower, upper);
+    CHECK(tree.range_search(lower, upper) ==
+          keysOf(std::map<key_type, int>(m.lower_bound(lower), m.upper_bound(upper))));
+  }
+
+  vector<key_type> keys;
+  key_type key;
+  tree.begin();
+  while(tree.next(key))
+    keys.push_back(key);
+  CHECK(keys == keysOf(m));
+}
+
+static int intKey(int i) { return i * 3; }
+static std::string stringKey(int i) { return "key" + std::to_string(i); }
+
+static void testCompact()
+{
+  compact_avlt<int, int> tree;
+  checkCommon(tree, intKey, 11);
+
+  std::map<int, int> m;
+  for(int k = 0; k < 8000; k++)
+  {
+    int value;
+    if(tree.search(intKey(k), value))
+      m.emplace(intKey(k), value);
+  }
+
+  std::mt19937 rng(12);
+  for(int i = 0; i < 10000; i++)
+  {
+    int key = intKey(rng() % 8000);
+    CHECK(tree.erase(key) == (m.erase(key) == 1));
+  }
+  CHECK(tree.size() == (int) m.size());
+  CHECK(tree.range_search(0, 1 << 30) == keysOf(m));
+
+  size_t before = tree.memory_usage();
+  for(int i = 0; i < 100; i++)
+    tree.insert(-1 - i, i);  // reuses erased slots
+  CHECK(tree.memory_usage() == before);
+}
+
+// what both wide_avlt layouts have beyond that: copy, move, swap,
+// (), % and dump
+template<typename Tree, typename MakeKey>
+static void checkWideExtras(Tree& tree, MakeKey makeKey)
+{
+  typedef decltype(makeKey(0)) key_type;
+  vector<key_type> keys;
+  key_type key;
+  tree.begin();
+  while(tree.next(key))
+    keys.push_back(key);
+
+  Tree copy(tree);
+  CHECK(copy.size() == tree.size() && copy.height() == tree.height());
+  CHECK(copy.range_search(keys.front(), keys.back()) == keys);
+  copy.insert(makeKey(9000), -5);  // the copy doesn't share blocks
+  CHECK(copy[makeKey(9000)] == -5 && tree[makeKey(9000)] == 0);
+
+  Tree assigned;
+  assigned.insert(makeKey(1), 1);
+  assigned = copy;
+  CHECK(assigned.size() == copy.size() && assigned[makeKey(9000)] == -5);
+
+  Tree moved(std::move(assigned));
+  CHECK(moved.size() == copy.size() && assigned.size() == 0);
+  assigned = std::move(moved);
+  CHECK(assigned.size() == copy.size() && moved.size() == 0);
+  swap(assigned, moved);
+  CHECK(moved.size() == copy.size() && assigned.size() == 0);
+
+  // () gives a later key (for blocks, the next one), % the height of
+  // where key is kept
+  for(size_t i = 0; i + 1 < keys.size(); i += 97)
+  {
+    CHECK(keys[i] < tree(keys[i]));
+    CHECK(tree % keys[i] >= 0 && tree % keys[i] <= tree.height());
+  }
+  CHECK(tree(keys.back()) == key_type{});
+  CHECK(tree(makeKey(9001)) == key_type{} && tree % makeKey(9001) == -1);
+
+  std::ostringstream out;
+  tree.dump(out);
+  CHECK(out.str().find("** size: " + std::to_string(tree.size()) + "\n") != std::string::npos);
+}
+
+static void testWide()
+{
+  wide_avlt<int, int> blocks;  // the block layout, for arithmetic keys
+  checkCommon(blocks, intKey, 21);
+  checkWideExtras(blocks, intKey);
+  vector<int> keys = blocks.range_search(0, 1 << 30);
+  for(size_t i = 0; i + 1 < keys.size(); i += 53)
+    CHECK(blocks(keys[i]) == keys[i + 1]);
+
+  wide_avlt<std::string, int> plain;  // just an avlt for other keys
+  checkCommon(plain, stringKey, 22);
+  checkWideExtras(plain, stringKey);
+}
+
+static void testPersistent()
+{
+  avlt<int, int> source;
+  for(int i = 0; i < 1000; i++)
+    source.insert(i, i);
+
+  persistent_avlt<int, int> tree(source);
+  CHECK(tree.size() == 1000 && tree[500] == 500);
+
+  const persistent_avlt<int, int> before = tree.snapshot();
+  for(int i = 0; i < 1000; i += 2)
+    tree.erase(i);
+  tree.insert(5000, 1);
+
+  CHECK(tree.size() == 501 && before.size() == 1000);
+  CHECK(tree[0] == 0 && before[0] == 0);
+  int value = -1;
+  CHECK(!tree.search(2, value) && before.search(2, value) && value == 2);
+  CHECK(!before.search(5000, value));
+  CHECK(tree.range_search(0, 6) == vector<int>({1, 3, 5}));
+  CHECK(before.range_search(0, 3) == vector<int>({0, 1, 2, 3}));
+}
+
+static void testConcurrent()
+{
+  concurrent_avlt<int, int> tree;
+  for(int i = 0; i < 1000; i++)
+    tree.insert(i * 2, i * 2);
+
+  // readers only ever see even keys with matching values, or nothing,
+  // while a writer keeps adding and removing odd keys
+  std::atomic<bool> stop(false);
+  std::atomic<int> bad(0);
+
+  std::thread writer([&]() {
+    for(int round = 0; round < 20; round++)
+    {
+      for(int i = 0; i < 1000; i++)
+        tree.insert(i * 2 + 1, -1);
+      for(int i = 0; i < 1000; i++)
+        tree.erase(i * 2 + 1);
+    }
+    stop = true;
+  });
+
+  std::thread reader([&]() {
+    std::mt19937 rng(31);
+    while(!stop)
+    {
+      int key = (rng() % 1000) * 2;
+      int value;
+      if(!tree.search(key, value) || value != key)
+        bad++;
+
+      vector<int> keys = tree.range_search(key, key + 10);
+      for(int k : keys)
+        if(k % 2 == 0 && k < 2000 && tree[k] != k)
+          bad++;
+    }
+  });
+
+  writer.join();
+  reader.join();
+
+  CHECK(bad == 0);
+  CHECK(tree.size() == 1000);
+  tree.clear();
+  CHECK(tree.size() == 0);
+}
+
+static void testSharded()
+{
+  // splitters sampled from the keys: 4 shards, evenly filled
+  vector<int> sample;
+  for(int i = 0; i < 1000; i++)
+    sample.push_back(i * 40);
+  typedef sharded_avlt<int, int> sharded;
+  vector<int> splitters = sharded::sample_splitters(sample, 4);
+  CHECK(splitters == vector<int>({10000, 20000, 30000}));
+  CHECK(sharded::sample_splitters(vector<int>(10, 5), 4).size() == 1);
+
+  sharded tree(splitters);
+  CHECK(tree.shard_count() == 4);
+
+  // writers with interleaved keys hit every shard at once
+  const int T = 4, N = 10000;
+  vector<std::thread> writers;
+  for(int t = 0; t < T; t++)
+    writers.emplace_back([&tree, t]() {
+      for(int i = t; i < N; i += T)
+        tree.insert(i * 4, i);
+    });
+  for(auto& w : writers)
+    w.join();
+
+  std::map<int, int> m;
+  for(int i = 0; i < N; i++)
+    m.emplace(i * 4, i);
+  CHECK(tree.size() == N);
+
+  // scans across shard boundaries come back in key order
+  vector<int> keys;
+  vector<int> values;
+  tree.for_each([&](int key, int value) { keys.push_back(key); values.push_back(value); });
+  CHECK(keys == keysOf(m));
+  CHECK(values[N - 1] == N - 1);
+
+  std::mt19937 rng(37);
+  for(int i = 0; i < 200; i++)
+  {
+    int lower = (int) (rng() % 42000) - 1000;
+    int upper = lower + (int) (rng() % 15000);
+    vector<int> expected;
+    for(auto it = m.lower_bound(lower); it != m.end() && it->first <= upper; ++it)
+      expected.push_back(it->first);
+    CHECK(tree.range_search(lower, upper) == expected);
+  }
+  CHECK(tree.range_search(5, 4).empty());
+
+  vector<pair<int, int>> batch;
+  for(int i = 0; i < 1000; i++)
+    batch.push_back(make_pair(i * 40 + 1, -i));
+  tree.insert_batch(batch);
+  CHECK(tree.size() == N + 1000);
+  CHECK(tree[39961] == -999 && tree[20000] == 5000);
+
+  int value;
+  CHECK(tree.erase(30000) && !tree.erase(30000));
+  CHECK(!tree.search(30000, value) && tree.search(30004, value) && value == 7501);
+  tree.clear();
+  CHECK(tree.size() == 0 && tree.shard_count() == 4);
+
+  // any comparator and key type avlt takes
+  sharded_avlt<std::string, int, std::greater<std::string>> names(vector<std::string>{"m", "f"});
+  names.insert("zed", 1);
+  names.insert("ann", 2);
+  names.insert("kim", 3);
+  CHECK((names.range_search("zzz", "a") == vector<std::string>{"zed", "kim", "ann"}));
+}
+
+// many readers against two writers, with enough erases that nodes keep
+// being reused; meant to be run under -fsanitize=thread or address too
+static void testConcurrentStress()
+{
+  concurrent_avlt<int, int> tree;
+  const int Keys = 2000;
+  for(int i = 0; i < Keys; i += 2)
+    tree.insert(i, i);
+
+  std::atomic<int> writing(2);
+  std::atomic<int> bad(0);
+  vector<std::thread> threads;
+
+  // writers add and remove odd keys, always with value -1
+  for(int w = 0; w < 2; w++)
+    threads.emplace_back([&tree, &writing, w]() {
+      std::mt19937 rng(50 + w);
+      for(int round = 0; round < 200; round++)
+      {
+        vector<pair<int, int>> batch;
+        for(int i = 0; i < 50; i++)
+        {
+          int key = (int) (rng() % (Keys / 2)) * 2 + 1;
+          if(i % 5 == 0)
+            batch.push_back(make_pair(key, -1));
+          else
+            tree.insert(key, -1);
+        }
+        tree.insert_batch(batch);
+        for(int i = 0; i < 60; i++)
+          tree.erase((int) (rng() % (Keys / 2)) * 2 + 1);
+      }
+      writing--;
+    });
+
+  // readers always find every even key, and odd keys only with -1
+  for(int r = 0; r < 4; r++)
+    threads.emplace_back([&tree, &writing, &bad, r]() {
+      std::mt19937 rng(60 + r);
+      while(writing > 0)
+      {
+        int key = (int) (rng() % Keys);
+        int value;
+        bool found = tree.search(key, value);
+        if((key % 2 == 0) ? (!found || value != key) : (found && value != -1))
+          bad++;
+
+        int lower = (int) (rng() % Keys);
+        int upper = lower + 40;
+        vector<int> keys = tree.range_search(lower, upper);
+        int evens = 0;
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+          if(keys[i] < lower || keys[i] > upper || (i > 0 && keys[i - 1] >= keys[i]))
+            bad++;
+          if(keys[i] % 2 == 0)
+            evens++;
+        }
+        int last = std::min(upper, Keys - 1);
+        if(evens != last / 2 - (lower + 1) / 2 + 1)
+          bad++;
+      }
+    });
+
+  for(auto& t : threads)
+    t.join();
+
+  CHECK(bad == 0);
+  for(int i = 1; i < Keys; i += 2)
+    tree.erase(i);
+  CHECK(tree.size() == Keys / 2);
+  CHECK(tree.range_search(0, Keys).size() == (size_t) Keys / 2);
+}
+
+int main()
+{
+  testCompact();
+  testWide();
+  testPersistent();
+  testConcurrent();
+  testConcurrentStress();
+  testSharded();
+
+  return test_result("variants_test");
+}
@@ -0,0 +1,818 @@
+/*wide_avlt.h*/
+
+//
+// AVL tree of sorted key blocks, searched with SIMD compares
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "avlt.h"
+
+using namespace std;
+
+//
+// wide_avlt keeps the basic avlt interface (copy and move, clear, size,
+// height, insert, search, [], (), %, range_search, begin/next and dump)
+// but each node of the balanced tree holds a sorted block of
+// up to BlockKeys keys instead of one. A lookup then touches one node per
+// BlockKeys keys, and inside a node the keys are compared several at a
+// time with SSE/AVX2 instructions; a range scan reads whole blocks, which
+// are chained in key order.
+//
+// Blocks only pay off for keys that compare as plain numbers, so this
+// layout is used when KeyT is an integer or floating-point type; for any
+// other key type, wide_avlt is simply an avlt. Either way it offers the
+// same members, so code written against one layout builds with the other.
+//
+template<typename KeyT, typename ValueT, bool Wide = std::is_arithmetic<KeyT>::value>
+class wide_avlt : private avlt<KeyT, ValueT>
+{
+private:
+  typedef avlt<KeyT, ValueT> tree_type;
+
+public:
+  using tree_type::clear;
+  using tree_type::size;
+  using tree_type::height;
+  using tree_type::search;
+  using tree_type::operator[];
+  using tree_type::operator();
+  using tree_type::operator%;
+  using tree_type::insert;
+  using tree_type::begin;
+  using tree_type::next;
+  using tree_type::dump;
+
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    return tree_type::range_search(lower, upper);
+  }
+
+  void swap(wide_avlt& other) noexcept
+  {
+    tree_type::swap(other);
+  }
+
+  friend void swap(wide_avlt& a, wide_avlt& b) noexcept
+  {
+    a.swap(b);
+  }
+};
+
+//
+// wide_block
+//
+// Counts the keys in keys[0..count) that are smaller than key, i.e. the
+// position key would go to in the block. The keys must be sorted. Blocks
+// always have room for a whole multiple of the vector width, so the
+// vector loads may read (but ignore) slots past count.
+//
+namespace wide_block
+{
+	inline int popcount(unsigned bits)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcount(bits);
+#else
+		int n = 0;
+		for(; bits != 0; bits &= bits - 1)
+			n++;
+		return n;
+#endif
+	}
+
+	// only the lanes below count are real keys
+	inline unsigned validLanes(unsigned mask, int count, int i, int lanes)
+	{
+		int valid = count - i;
+		return (valid >= lanes) ? mask : (mask & ((1u << valid) - 1));
+	}
+
+	template<typename KeyT>
+	int lower(const KeyT* keys, int count, const KeyT& key)
+	{
+		int pos = 0;
+
+#if defined(__AVX2__)
+		if constexpr (std::is_integral<KeyT>::value && sizeof(KeyT) == 4)
+		{
+			// unsigned keys get their top bit flipped to compare as signed
+			const int bias = std::is_signed<KeyT>::value ? 0 : (int) 0x80000000u;
+			__m256i flip = _mm256_set1_epi32(bias);
+			__m256i k = _mm256_xor_si256(_mm256_set1_epi32((int) key), flip);
+			for(int i = 0; i < count; i += 8)
+			{
+				__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (keys + i)), flip);
+				unsigned mask = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+				pos += popcount(validLanes(mask, count, i, 8));
+			}
+			return pos;
+		}
+		else if constexpr (std::is_integral<KeyT>::value && sizeof(KeyT) == 8)
+		{
+			const long long bias = std::is_signed<KeyT>::value ? 0 : (long long) 0x8000000000000000ull;
+			__m256i flip = _mm256_set1_epi64x(bias);
+			__m256i k = _mm256_xor_si256(_mm256_set1_epi64x((long long) key), flip);
+			for(int i = 0; i < count; i += 4)
+			{
+				__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (keys + i)), flip);
+				unsigned mask = (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v)));
+				pos += popcount(validLanes(mask, count, i, 4));
+			}
+			return pos;
+		}
+		else if constexpr (std::is_same<KeyT, float>::value)
+		{
+			__m256 k = _mm256_set1_ps(key);
+			for(int i = 0; i < count; i += 8)
+			{
+				unsigned mask = (unsigned) _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(keys + i), k, _CMP_LT_OQ));
+				pos += popcount(validLanes(mask, count, i, 8));
+			}
+			return pos;
+		}
+		else if constexpr (std::is_same<KeyT, double>::value)
+		{
+			__m256d k = _mm256_set1_pd(key);
+			for(int i = 0; i < count; i += 4)
+			{
+				unsigned mask = (unsigned) _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(keys + i), k, _CMP_LT_OQ));
+				pos += popcount(validLanes(mask, count, i, 4));
+			}
+			return pos;
+		}
+#elif defined(__SSE2__)
+		if constexpr (std::is_integral<KeyT>::value && sizeof(KeyT) == 4)
+		{
+			const int bias = std::is_signed<KeyT>::value ? 0 : (int) 0x80000000u;
+			__m128i flip = _mm_set1_epi32(bias);
+			__m128i k = _mm_xor_si128(_mm_set1_epi32((int) key), flip);
+			for(int i = 0; i < count; i += 4)
+			{
+				__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (keys + i)), flip);
+				unsigned mask = (unsigned) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k)));
+				pos += popcount(validLanes(mask, count, i, 4));
+			}
+			return pos;
+		}
+		else if constexpr (std::is_same<KeyT, float>::value)
+		{
+			__m128 k = _mm_set1_ps(key);
+			for(int i = 0; i < count; i += 4)
+			{
+				unsigned mask = (unsigned) _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(keys + i), k));
+				pos += popcount(validLanes(mask, count, i, 4));
+			}
+			return pos;
+		}
+		else if constexpr (std::is_same<KeyT, double>::value)
+		{
+			__m128d k = _mm_set1_pd(key);
+			for(int i = 0; i < count; i += 2)
+			{
+				unsigned mask = (unsigned) _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(keys + i), k));
+				pos += popcount(validLanes(mask, count, i, 2));
+			}
+			return pos;
+		}
+#endif
+
+		// no vector compare for this type: a branch-free count the
+		// compiler can still vectorize
+		for(int i = 0; i < count; i++)
+			pos += (keys[i] < key) ? 1 : 0;
+		return pos;
+	}
+}
+
+template<typename KeyT, typename ValueT>
+class wide_avlt<KeyT, ValueT, true>
+{
+public:
+  static const int BlockKeys = 16;  // keys per node; a multiple of every vector width
+
+private:
+  struct NODE
+  {
+    KeyT   Keys[BlockKeys];    // sorted; only the first Count are real
+    ValueT Values[BlockKeys];  // Values[i] goes with Keys[i]
+    int    Count;              // # of keys in this block, 1..BlockKeys
+    NODE*  Left;
+    NODE*  Right;
+    NODE*  Next;               // next block in key order (nullptr if last)
+    int    Height;             // height of tree rooted at this node
+  };
+
+  NODE* Root;      // pointer to root node of tree (nullptr if empty)
+  int   Size;      // # of keys in the tree (0 if empty)
+  NODE* Cursor;    // block begin()/next() is in
+  int   CursorAt;  // position in that block
+  bool  hasBegun;  // Checks whether or not the tree has called begin()
+
+	static int height(NODE* node)
+	{
+		return (node == nullptr) ? -1 : node->Height;
+	}
+
+	static void fixHeight(NODE* node)
+	{
+		node->Height = 1 + max(height(node->Left), height(node->Right));
+	}
+
+	static NODE* right_rotate(NODE* cur)
+	{
+		NODE* cl = cur->Left;
+		cur->Left = cl->Right;
+		cl->Right = cur;
+		fixHeight(cur);
+		fixHeight(cl);
+		return cl;
+	}
+
+	static NODE* left_rotate(NODE* cur)
+	{
+		NODE* cr = cur->Right;
+		cur->Right = cr->Left;
+		cr->Left = cur;
+		fixHeight(cur);
+		fixHeight(cr);
+		return cr;
+	}
+
+	/* rebalance()
+	 *
+	 * fixes the height of a node whose subtree just grew, and rotates if
+	 * one side got more than 1 taller than the other
+	 */
+
+	static NODE* rebalance(NODE* cur)
+	{
+		fixHeight(cur);
+		int balance = height(cur->Left) - height(cur->Right);
+
+		if(balance >= 2)
+		{
+			if(height(cur->Left->Left) < height(cur->Left->Right))  //Left Right Rotate
+				cur->Left = left_rotate(cur->Left);
+			return right_rotate(cur);
+		}
+		if(balance <= -2)
+		{
+			if(height(cur->Right->Right) < height(cur->Right->Left))  //Right Left Rotate
+				cur->Right = right_rotate(cur->Right);
+			return left_rotate(cur);
+		}
+		return cur;
+	}
+
+	/* insertBlock()
+	 *
+	 * links a new block into the subtree by its smallest key; every key of
+	 * the block lies between two neighbouring blocks, so that one key is
+	 * enough to find its place
+	 */
+
+	static NODE* insertBlock(NODE* node, NODE* block)
+	{
+		if(node == nullptr)
+			return block;
+
+		if(block->Keys[0] < node->Keys[0])
+			node->Left = insertBlock(node->Left, block);
+		else
+			node->Right = insertBlock(node->Right, block);
+		return rebalance(node);
+	}
+
+	static void insertAt(NODE* node, int pos, const KeyT& key, const ValueT& value)
+	{
+		for(int i = node->Count; i > pos; i--)
+		{
+			node->Keys[i] = node->Keys[i - 1];
+			node->Values[i] = node->Values[i - 1];
+		}
+		node->Keys[pos] = key;
+		node->Values[pos] = value;
+		node->Count++;
+	}
+
+	static NODE* newBlock()
+	{
+		NODE* node = new NODE();  // zeroed, so the vector loads past Count read defined keys
+		node->Count = 0;
+		node->Left = nullptr;
+		node->Right = nullptr;
+		node->Next = nullptr;
+		node->Height = 0;
+		return node;
+	}
+
+	/* cloneTree()
+	 *
+	 * copies the subtree under node block for block; prev is the copy made
+	 * just before, in key order, and gets chained to each new copy so the
+	 * Next links come out the same as in the original
+	 */
+
+	static NODE* cloneTree(const NODE* node, NODE*& prev)
+	{
+		if(node == nullptr)
+			return nullptr;
+
+		NODE* copy = new NODE(*node);  // keys, values, Count and Height
+		copy->Left = cloneTree(node->Left, prev);
+		if(prev != nullptr)
+			prev->Next = copy;
+		copy->Next = nullptr;
+		prev = copy;
+		copy->Right = cloneTree(node->Right, prev);
+		return copy;
+	}
+
+	static void clearTree(NODE* node)
+	{
+		while(node != nullptr)
+		{
+			clearTree(node->Left);
+			NODE* right = node->Right;
+			delete node;
+			node = right;
+		}
+	}
+
+	/* floorBlock()
+	 *
+	 * the last block whose first key is <= key, or nullptr if key is
+	 * smaller than every key; one compare per level, like avlt's
+	 * lowerNode()
+	 */
+
+	NODE* floorBlock(const KeyT& key) const
+	{
+		NODE* cur = Root;
+		NODE* floor = nullptr;  // last block starting at or before key so far
+		while(cur != nullptr)
+		{
+			if(key < cur->Keys[0])
+				cur = cur->Left;
+			else
+			{
+				floor = cur;
+				cur = cur->Right;
+			}
+		}
+		return floor;
+	}
+
+	/* findBlock()
+	 *
+	 * the block whose key range holds key, or nullptr; only the floor
+	 * block's last key is checked, once, at the bottom
+	 */
+
+	NODE* findBlock(const KeyT& key) const
+	{
+		NODE* node = floorBlock(key);
+		return (node != nullptr && !(node->Keys[node->Count - 1] < key)) ? node : nullptr;
+	}
+
+	/* findKey()
+	 *
+	 * the block holding key, with key's position in it via pos, or nullptr
+	 */
+
+	NODE* findKey(const KeyT& key, int& pos) const
+	{
+		NODE* node = findBlock(key);
+		if(node == nullptr)
+			return nullptr;
+
+		pos = wide_block::lower(node->Keys, node->Count, key);
+		if(pos == node->Count || key < node->Keys[pos])  // Keys[pos] >= key, so not equal
+			return nullptr;
+		return node;
+	}
+
+	const ValueT* findValue(const KeyT& key) const
+	{
+		int pos;
+		NODE* node = findKey(key, pos);
+		return (node == nullptr) ? nullptr : &node->Values[pos];
+	}
+
+public:
+
+  //
+  // default constructor:
+  //
+  // Creates an empty tree.
+  //
+  wide_avlt()
+  {
+    Root = nullptr;
+    Size = 0;
+    Cursor = nullptr;
+    CursorAt = 0;
+    hasBegun = false;
+  }
+
+  //
+  // copy constructor:
+  //
+  // Makes an exact copy of the "other" tree, block for block, so no
+  // splits or rotations are needed.
+  //
+  // Time complexity:  O(N)
+  //
+  wide_avlt(const wide_avlt& other)
+  {
+    NODE* prev = nullptr;
+    Root = cloneTree(other.Root, prev);
+    Size = other.Size;
+    Cursor = nullptr;
+    CursorAt = 0;
+    hasBegun = false;
+  }
+
+  //
+  // operator=
+  //
+  // Clears "this" tree and then makes a copy of the "other" tree.
+  //
+  // Time complexity:  O(N)
+  //
+  wide_avlt& operator=(const wide_avlt& other)
+  {
+    if(this == &other)
+      return *this;
+
+    wide_avlt copy(other);
+    swap(copy);
+    return *this;
+  }
+
+  //
+  // move constructor
+  //
+  // Takes over the blocks of the "other" tree, leaving it empty.
+  //
+  // Time complexity:  O(1)
+  //
+  wide_avlt(wide_avlt&& other) noexcept
+  {
+    Root = other.Root;
+    Size = other.Size;
+    Cursor = other.Cursor;
+    CursorAt = other.CursorAt;
+    hasBegun = other.hasBegun;
+
+    other.Root = nullptr;
+    other.Size = 0;
+    other.Cursor = nullptr;
+    other.CursorAt = 0;
+    other.hasBegun = false;
+  }
+
+  //
+  // move operator=
+  //
+  // Clears "this" tree and then takes over the blocks of the "other"
+  // tree, leaving it empty.
+  //
+  // Time complexity:  O(N) to clear "this" tree
+  //
+  wide_avlt& operator=(wide_avlt&& other) noexcept
+  {
+    if(this == &other)
+      return *this;
+
+    this->clear();
+    swap(other);
+    return *this;
+  }
+
+  //
+  // swap
+  //
+  // Exchanges the contents of "this" tree and the "other" tree.
+  //
+  // Time complexity:  O(1)
+  //
+  void swap(wide_avlt& other) noexcept
+  {
+    using std::swap;
+    swap(Root, other.Root);
+    swap(Size, other.Size);
+    swap(Cursor, other.Cursor);
+    swap(CursorAt, other.CursorAt);
+    swap(hasBegun, other.hasBegun);
+  }
+
+  friend void swap(wide_avlt& a, wide_avlt& b) noexcept
+  {
+    a.swap(b);
+  }
+
+  //
+  // destructor:
+  //
+  ~wide_avlt()
+  {
+    clearTree(Root);
+  }
+
+  //
+  // clear:
+  //
+  // Clears the contents of the tree, resetting the tree to empty.
+  //
+  void clear()
+  {
+    clearTree(Root);
+    Root = nullptr;
+    Size = 0;
+    Cursor = nullptr;
+    hasBegun = false;
+  }
+
+  //
+  // size:
+  //
+  // Returns the # of keys in the tree, 0 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int size() const
+  {
+    return Size;
+  }
+
+  //
+  // height:
+  //
+  // Returns the height of the tree of blocks, -1 if empty.
+  //
+  // Time complexity:  O(1)
+  //
+  int height() const
+  {
+    return height(Root);
+  }
+
+  //
+  // search:
+  //
+  // Searches the tree for the given key, returning true if found
+  // and false if not.  If the key is found, the corresponding value
+  // is returned via the reference parameter.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  bool search(const KeyT& key, ValueT& value) const
+  {
+    const ValueT* found = findValue(key);
+    if(found == nullptr)
+      return false;
+
+    value = *found;
+    return true;
+  }
+
+  //
+  // []
+  //
+  // Returns the value for the given key; if the key is not found,
+  // the default value ValueT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  ValueT operator[](const KeyT& key) const
+  {
+    const ValueT* found = findValue(key);
+    return (found == nullptr) ? ValueT{} : *found;
+  }
+
+  //
+  // ()
+  //
+  // Finds the key in the tree, and returns the key to its "right": the
+  // next key in its block, or else the first key of the next block, which
+  // is always the next inorder key.
+  //
+  // If the key isn't found, or is the last key, the default key value
+  // KeyT{} is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  KeyT operator()(const KeyT& key) const
+  {
+    int pos;
+    NODE* node = findKey(key, pos);
+    if(node == nullptr)
+      return KeyT{};
+
+    if(pos + 1 < node->Count)
+      return node->Keys[pos + 1];
+    return (node->Next == nullptr) ? KeyT{} : node->Next->Keys[0];
+  }
+
+  //
+  // %
+  //
+  // Returns the height stored in the block that contains key; if key is
+  // not found, -1 is returned.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  int operator%(const KeyT& key) const
+  {
+    int pos;
+    NODE* node = findKey(key, pos);
+    return (node == nullptr) ? -1 : node->Height;
+  }
+
+  //
+  // range_search
+  //
+  // Returns all keys in the range [lower..upper], inclusive, reading the
+  // chained blocks one after the other.
+  //
+  // Time complexity: O(lgN + M), where M is the # of keys in the range
+  //
+  vector<KeyT> range_search(const KeyT& lower, const KeyT& upper) const
+  {
+    vector<KeyT> keys;
+
+    // first block with a key >= lower
+    NODE* cur = Root;
+    NODE* node = nullptr;
+    while(cur != nullptr)
+    {
+      if(cur->Keys[cur->Count - 1] < lower)
+        cur = cur->Right;
+      else
+      {
+        node = cur;
+        cur = cur->Left;
+      }
+    }
+
+    if(node == nullptr)
+      return keys;
+
+    int pos = wide_block::lower(node->Keys, node->Count, lower);
+    for(; node != nullptr; node = node->Next, pos = 0)
+    {
+      for(; pos < node->Count; pos++)
+      {
+        if(upper < node->Keys[pos])
+          return keys;
+        keys.push_back(node->Keys[pos]);
+      }
+    }
+    return keys;
+  }
+
+  //
+  // insert
+  //
+  // Inserts the given key into the tree; if the key has already been insert then
+  // the function returns without changing the tree. The key goes into the
+  // block whose range it falls in (or next to); a full block is split in
+  // half and the new half linked into the tree, rotating as necessary.
+  //
+  // Time complexity:  O(lgN) worst-case
+  //
+  void insert(const KeyT& key, const ValueT& value)
+  {
+    if(Root == nullptr)
+    {
+      Root = newBlock();
+      insertAt(Root, 0, key, value);
+      Size = 1;
+      return;
+    }
+
+    // the last block starting at or before key, or the first block if
+    // key is smaller than every key; either way key's place is in it
+    NODE* node = floorBlock(key);
+    if(node == nullptr)
+    {
+      node = Root;
+      while(node->Left != nullptr)
+        node = node->Left;
+    }
+
+    int pos = wide_block::lower(node->Keys, node->Count, key);
+    if(pos < node->Count && !(key < node->Keys[pos]))  // already in tree
+      return;
+
+    Size++;
+
+    if(node->Count < BlockKeys)
+    {
+      insertAt(node, pos, key, value);
+      return;
+    }
+
+    // full: the upper half moves to a new block right after this one
+    NODE* upper = newBlock();
+    int half = BlockKeys / 2;
+    for(int i = half; i < BlockKeys; i++)
+    {
+      upper->Keys[i - half] = node->Keys[i];
+      upper->Values[i - half] = node->Values[i];
+    }
+    upper->Count = BlockKeys - half;
+    node->Count = half;
+
+    upper->Next = node->Next;
+    node->Next = upper;
+
+    if(pos <= half)
+      insertAt(node, pos, key, value);
+    else
+      insertAt(upper, pos - half, key, value);
+
+    Root = insertBlock(Root, upper);
+  }
+
+  //
+  // begin
+  //
+  // Resets internal state for an inorder traversal, like avlt::begin.
+  //
+  // Example usage:
+  //    tree.begin();
+  //    while (tree.next(key))
+  //      cout << key << endl;
+  //
+  void begin()
+  {
+    Cursor = Root;
+    if(Cursor != nullptr)
+      while(Cursor->Left != nullptr)
+        Cursor = Cursor->Left;
+
+    CursorAt = 0;
+    hasBegun = true;
+  }
+
+  //
+  // next
+  //
+  // Returns the next inorder key via the reference parameter, or false
+  // once there are no more, like avlt::next.
+  //
+  // Time complexity:  O(1)
+  //
+  bool next(KeyT& key)
+  {
+    if(Cursor == nullptr || hasBegun == false)
+      return false;
+
+    key = Cursor->Keys[CursorAt++];
+    if(CursorAt == Cursor->Count)
+    {
+      Cursor = Cursor->Next;
+      CursorAt = 0;
+    }
+    return true;
+  }
+
+  //
+  // dump
+  //
+  // Dumps the contents of the tree to the output stream, one
+  // (key,value,height) per line in key order, where height is that of
+  // the key's block.
+  //
+  void dump(ostream& output) const
+  {
+    output << "**************************************************" << endl;
+    output << "******************* WIDE AVLT ********************" << endl;
+
+    output << "** size: " << this->size() << endl;
+    output << "** height: " << this->height() << endl;
+
+    NODE* node = Root;
+    if(node != nullptr)
+      while(node->Left != nullptr)
+        node = node->Left;
+
+    for(; node != nullptr; node = node->Next)
+      for(int i = 0; i < node->Count; i++)
+        output << "(" << node->Keys[i] << "," << node->Values[i] << "," << node->Height << ")" << endl;
+
+    output << "**************************************************" << endl;
+  }
+};